@@ -0,0 +1,66 @@
+// Copyright Istio Authors. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "extensions/common/cluster_metadata.h"
+
+#include "envoy/registry/registry.h"
+
+#include "source/common/common/macros.h"
+
+namespace Istio {
+namespace Common {
+
+namespace {
+const std::string& clusterMetadataKey() {
+  CONSTRUCT_ON_FIRST_USE(std::string, std::string(ClusterMetadataKey));
+}
+} // namespace
+
+const ClusterMetadataDigest* ClusterMetadataDigest::get(const Envoy::Upstream::ClusterInfo& info) {
+  return info.typedMetadata().get<ClusterMetadataDigest>(clusterMetadataKey());
+}
+
+std::unique_ptr<const Envoy::Config::TypedMetadata::Object>
+ClusterMetadataDigestFactory::parse(const Envoy::ProtobufWkt::Struct& data) const {
+  auto digest = std::make_unique<ClusterMetadataDigest>();
+  const auto& fields = data.fields();
+  const auto services_it = fields.find("services");
+  if (services_it != fields.end() && services_it->second.list_value().values_size() > 0) {
+    digest->has_service_ = true;
+    const auto& service = services_it->second.list_value().values(0).struct_value().fields();
+    const auto host_it = service.find("host");
+    if (host_it != service.end()) {
+      digest->service_host_ = host_it->second.string_value();
+    }
+    const auto name_it = service.find("name");
+    if (name_it != service.end()) {
+      digest->service_name_ = name_it->second.string_value();
+    }
+    const auto namespace_it = service.find("namespace");
+    if (namespace_it != service.end()) {
+      digest->service_namespace_ = namespace_it->second.string_value();
+    }
+  }
+  const auto external_it = fields.find("external");
+  digest->external_ = external_it != fields.end() && external_it->second.bool_value();
+  const auto alpn_override_it = fields.find("alpn_override");
+  digest->alpn_override_disabled_ =
+      alpn_override_it != fields.end() && alpn_override_it->second.string_value() == "false";
+  return digest;
+}
+
+REGISTER_FACTORY(ClusterMetadataDigestFactory, Envoy::Upstream::ClusterTypedMetadataFactory);
+
+} // namespace Common
+} // namespace Istio
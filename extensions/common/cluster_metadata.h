@@ -0,0 +1,61 @@
+// Copyright Istio Authors. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#pragma once
+
+#include "envoy/config/typed_metadata.h"
+#include "envoy/upstream/upstream.h"
+
+#include "source/common/protobuf/protobuf.h"
+
+#include "absl/types/optional.h"
+
+namespace Istio {
+namespace Common {
+
+// Cluster filter metadata key set by the control plane.
+constexpr absl::string_view ClusterMetadataKey = "istio";
+
+// Istio cluster metadata read by the filters on every request, parsed once per cluster update
+// instead of walking the metadata struct per request.
+struct ClusterMetadataDigest : public Envoy::Config::TypedMetadata::Object {
+  // Returns the digest of the cluster, or nullptr if the cluster has no Istio metadata.
+  static const ClusterMetadataDigest* get(const Envoy::Upstream::ClusterInfo& info);
+
+  // Set if the cluster has at least one service. Only the first service is kept.
+  bool has_service_{false};
+  absl::optional<std::string> service_host_;
+  absl::optional<std::string> service_name_;
+  std::string service_namespace_;
+
+  // "external": the cluster is outside of the mesh.
+  bool external_{false};
+
+  // "alpn_override" is "false": the ALPN rewrite is disabled.
+  bool alpn_override_disabled_{false};
+};
+
+class ClusterMetadataDigestFactory : public Envoy::Upstream::ClusterTypedMetadataFactory {
+public:
+  std::string name() const override { return std::string(ClusterMetadataKey); }
+  std::unique_ptr<const Envoy::Config::TypedMetadata::Object>
+  parse(const Envoy::ProtobufWkt::Struct& data) const override;
+  std::unique_ptr<const Envoy::Config::TypedMetadata::Object>
+  parse(const Envoy::ProtobufWkt::Any&) const override {
+    return nullptr;
+  }
+};
+
+} // namespace Common
+} // namespace Istio
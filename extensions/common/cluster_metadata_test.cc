@@ -0,0 +1,88 @@
+// Copyright Istio Authors. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "extensions/common/cluster_metadata.h"
+
+#include "source/common/config/metadata.h"
+
+#include "test/test_common/utility.h"
+
+#include "gmock/gmock.h"
+#include "gtest/gtest.h"
+
+namespace Istio {
+namespace Common {
+
+using ClusterTypedMetadata =
+    Envoy::Config::TypedMetadataImpl<Envoy::Upstream::ClusterTypedMetadataFactory>;
+
+TEST(ClusterMetadataDigestTest, Service) {
+  const ClusterTypedMetadata metadata(
+      Envoy::TestUtility::parseYaml<envoy::config::core::v3::Metadata>(R"EOF(
+        filter_metadata:
+          istio:
+            services:
+            - host: foo.default.svc.cluster.local
+              name: foo
+              namespace: default
+            - host: bar.default.svc.cluster.local
+      )EOF"));
+  const auto* digest = metadata.get<ClusterMetadataDigest>(std::string(ClusterMetadataKey));
+  ASSERT_NE(digest, nullptr);
+  EXPECT_TRUE(digest->has_service_);
+  EXPECT_EQ(digest->service_host_, "foo.default.svc.cluster.local");
+  EXPECT_EQ(digest->service_name_, "foo");
+  EXPECT_EQ(digest->service_namespace_, "default");
+  EXPECT_FALSE(digest->external_);
+  EXPECT_FALSE(digest->alpn_override_disabled_);
+}
+
+TEST(ClusterMetadataDigestTest, ServiceWithoutName) {
+  const ClusterTypedMetadata metadata(
+      Envoy::TestUtility::parseYaml<envoy::config::core::v3::Metadata>(R"EOF(
+        filter_metadata:
+          istio:
+            services:
+            - host: foo.default.svc.cluster.local
+      )EOF"));
+  const auto* digest = metadata.get<ClusterMetadataDigest>(std::string(ClusterMetadataKey));
+  ASSERT_NE(digest, nullptr);
+  EXPECT_TRUE(digest->has_service_);
+  EXPECT_EQ(digest->service_host_, "foo.default.svc.cluster.local");
+  EXPECT_FALSE(digest->service_name_.has_value());
+  EXPECT_EQ(digest->service_namespace_, "");
+}
+
+TEST(ClusterMetadataDigestTest, Flags) {
+  const ClusterTypedMetadata metadata(
+      Envoy::TestUtility::parseYaml<envoy::config::core::v3::Metadata>(R"EOF(
+        filter_metadata:
+          istio:
+            external: true
+            alpn_override: "false"
+      )EOF"));
+  const auto* digest = metadata.get<ClusterMetadataDigest>(std::string(ClusterMetadataKey));
+  ASSERT_NE(digest, nullptr);
+  EXPECT_FALSE(digest->has_service_);
+  EXPECT_TRUE(digest->external_);
+  EXPECT_TRUE(digest->alpn_override_disabled_);
+}
+
+TEST(ClusterMetadataDigestTest, NoMetadata) {
+  const ClusterTypedMetadata metadata(envoy::config::core::v3::Metadata{});
+  EXPECT_EQ(metadata.get<ClusterMetadataDigest>(std::string(ClusterMetadataKey)), nullptr);
+}
+
+} // namespace Common
+} // namespace Istio
@@ -31,6 +31,11 @@ namespace Common {
 constexpr absl::string_view DownstreamPeer = "downstream_peer";
 constexpr absl::string_view UpstreamPeer = "upstream_peer";
 
+// Filter state key to store the downstream peer metadata resolved once per connection from the
+// remote address by the peer metadata listener filter. Consumers prefer the metadata stored under
+// DownstreamPeer and fall back to this key before doing their own workload discovery lookup.
+constexpr absl::string_view ConnectionPeer = "connection_peer";
+
 // Special filter state key to indicate the filter is done looking for peer metadata.
 // This is used by network metadata exchange on failure.
 constexpr absl::string_view NoPeer = "peer_not_found";
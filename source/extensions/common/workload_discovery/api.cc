@@ -65,6 +65,22 @@ Istio::Common::WorkloadMetadataObject convert(const istio::workload::Workload& w
       workload.canonical_name(), workload.canonical_revision(), workload.canonical_name(),
       workload.canonical_revision(), workload_type, identity);
 }
+
+// Identity lookups resolve to a workload rather than an instance, so the instance name is dropped.
+Istio::Common::WorkloadMetadataObject
+convertIdentity(const Istio::Common::WorkloadMetadataObject& obj) {
+  return Istio::Common::WorkloadMetadataObject("", obj.cluster_name_, obj.namespace_name_,
+                                               obj.workload_name_, obj.canonical_name_,
+                                               obj.canonical_revision_, obj.app_name_,
+                                               obj.app_version_, obj.workload_type_, obj.identity_);
+}
+
+bool sameWorkload(const Istio::Common::WorkloadMetadataObject& a,
+                  const Istio::Common::WorkloadMetadataObject& b) {
+  return a.workload_name_ == b.workload_name_ && a.namespace_name_ == b.namespace_name_ &&
+         a.cluster_name_ == b.cluster_name_ && a.canonical_name_ == b.canonical_name_ &&
+         a.canonical_revision_ == b.canonical_revision_;
+}
 } // namespace
 
 class WorkloadMetadataProviderImpl : public WorkloadMetadataProvider, public Singleton::Instance {
@@ -101,22 +117,61 @@ public:
     return {};
   }
 
+  std::optional<Istio::Common::WorkloadMetadataObject>
+  GetMetadataByIdentity(absl::string_view identity) override {
+    if (identity.empty()) {
+      return {};
+    }
+    return tls_->getByIdentity(identity);
+  }
+
+  std::optional<Istio::Common::WorkloadMetadataObject>
+  GetMetadataByUid(absl::string_view uid) override {
+    if (uid.empty()) {
+      return {};
+    }
+    return tls_->getByUid(uid);
+  }
+
+  bool HasUid(absl::string_view uid) override { return !uid.empty() && tls_->hasUid(uid); }
+
 private:
   using IdToAddress = absl::flat_hash_map<std::string, std::vector<std::string>>;
   using IdToAddressSharedPtr = std::shared_ptr<IdToAddress>;
   using AddressToWorkload = absl::flat_hash_map<std::string, Istio::Common::WorkloadMetadataObject>;
   using AddressToWorkloadSharedPtr = std::shared_ptr<AddressToWorkload>;
+  using IdToWorkload = absl::flat_hash_map<std::string, Istio::Common::WorkloadMetadataObject>;
+  using IdToWorkloadSharedPtr = std::shared_ptr<IdToWorkload>;
+
+  // All workloads sharing a SPIFFE identity. The identity resolves to the first workload as long
+  // as all the other workloads agree with it on the telemetry attributes.
+  struct IdentityEntry {
+    explicit IdentityEntry(const Istio::Common::WorkloadMetadataObject& workload)
+        : workload_(workload) {}
+    Istio::Common::WorkloadMetadataObject workload_;
+    absl::flat_hash_set<std::string> ids_;
+    // Sticky until all the workloads under the identity are removed.
+    bool ambiguous_{false};
+  };
 
   struct ThreadLocalProvider : public ThreadLocal::ThreadLocalObject {
-    void reset(const AddressToWorkloadSharedPtr& index) { address_to_workload_ = *index; }
+    void reset(const AddressToWorkloadSharedPtr& index, const IdToWorkloadSharedPtr& workloads) {
+      address_to_workload_ = *index;
+      id_to_workload_.clear();
+      identity_to_workload_.clear();
+      for (const auto& [id, workload] : *workloads) {
+        addWorkload(id, workload);
+      }
+    }
     void update(const AddressToWorkloadSharedPtr& added_addresses,
-                const IdToAddressSharedPtr& added_ids,
+                const IdToAddressSharedPtr& added_ids, const IdToWorkloadSharedPtr& added_workloads,
                 const std::shared_ptr<std::vector<std::string>> removed) {
       for (const auto& id : *removed) {
         for (const auto& address : id_to_address_[id]) {
           address_to_workload_.erase(address);
         }
         id_to_address_.erase(id);
+        removeWorkload(id);
       }
       for (const auto& [address, workload] : *added_addresses) {
         address_to_workload_.emplace(address, workload);
@@ -124,8 +179,12 @@ private:
       for (const auto& [id, address] : *added_ids) {
         id_to_address_.emplace(id, address);
       }
+      for (const auto& [id, workload] : *added_workloads) {
+        addWorkload(id, workload);
+      }
     }
     size_t total() const { return address_to_workload_.size(); }
+    size_t identities() const { return identity_to_workload_.size(); }
     // Returns by-value since the flat map does not provide pointer stability.
     std::optional<Istio::Common::WorkloadMetadataObject> get(const std::string& address) {
       const auto it = address_to_workload_.find(address);
@@ -134,8 +193,50 @@ private:
       }
       return {};
     }
+    std::optional<Istio::Common::WorkloadMetadataObject> getByUid(absl::string_view uid) {
+      const auto it = id_to_workload_.find(uid);
+      if (it != id_to_workload_.end()) {
+        return it->second;
+      }
+      return {};
+    }
+    bool hasUid(absl::string_view uid) const { return id_to_workload_.contains(uid); }
+    std::optional<Istio::Common::WorkloadMetadataObject> getByIdentity(absl::string_view identity) {
+      const auto it = identity_to_workload_.find(identity);
+      if (it != identity_to_workload_.end() && !it->second.ambiguous_) {
+        return it->second.workload_;
+      }
+      return {};
+    }
+    void addWorkload(const std::string& id, const Istio::Common::WorkloadMetadataObject& workload) {
+      // The workload may be re-added with a different identity.
+      removeWorkload(id);
+      id_to_workload_.emplace(id, workload);
+      auto [it, inserted] =
+          identity_to_workload_.try_emplace(workload.identity_, convertIdentity(workload));
+      if (!inserted && !sameWorkload(it->second.workload_, workload)) {
+        it->second.ambiguous_ = true;
+      }
+      it->second.ids_.insert(id);
+    }
+    void removeWorkload(const std::string& id) {
+      const auto id_it = id_to_workload_.find(id);
+      if (id_it == id_to_workload_.end()) {
+        return;
+      }
+      const auto it = identity_to_workload_.find(id_it->second.identity_);
+      if (it != identity_to_workload_.end()) {
+        it->second.ids_.erase(id);
+        if (it->second.ids_.empty()) {
+          identity_to_workload_.erase(it);
+        }
+      }
+      id_to_workload_.erase(id_it);
+    }
     IdToAddress id_to_address_;
     AddressToWorkload address_to_workload_;
+    IdToWorkload id_to_workload_;
+    absl::flat_hash_map<std::string, IdentityEntry> identity_to_workload_;
   };
   class WorkloadSubscription : Config::SubscriptionBase<istio::workload::Workload> {
   public:
@@ -158,6 +259,7 @@ private:
     absl::Status onConfigUpdate(const std::vector<Config::DecodedResourceRef>& resources,
                                 const std::string&) override {
       AddressToWorkloadSharedPtr index = std::make_shared<AddressToWorkload>();
+      IdToWorkloadSharedPtr workloads = std::make_shared<IdToWorkload>();
       for (const auto& resource : resources) {
         const auto& workload =
             dynamic_cast<const istio::workload::Workload&>(resource.get().resource());
@@ -165,8 +267,9 @@ private:
         for (const auto& addr : workload.addresses()) {
           index->emplace(addr, metadata);
         }
+        workloads->emplace(workload.uid(), metadata);
       }
-      parent_.reset(index);
+      parent_.reset(index, workloads);
       return absl::OkStatus();
     }
     absl::Status onConfigUpdate(const std::vector<Config::DecodedResourceRef>& added_resources,
@@ -174,6 +277,7 @@ private:
                                 const std::string&) override {
       IdToAddressSharedPtr added_ids = std::make_shared<IdToAddress>();
       AddressToWorkloadSharedPtr added_addresses = std::make_shared<AddressToWorkload>();
+      IdToWorkloadSharedPtr added_workloads = std::make_shared<IdToWorkload>();
       for (const auto& resource : added_resources) {
         const auto& workload =
             dynamic_cast<const istio::workload::Workload&>(resource.get().resource());
@@ -183,13 +287,14 @@ private:
         }
         added_ids->emplace(workload.uid(), std::vector<std::string>(workload.addresses().begin(),
                                                                     workload.addresses().end()));
+        added_workloads->emplace(workload.uid(), metadata);
       }
       auto removed = std::make_shared<std::vector<std::string>>();
       removed->reserve(removed_resources.size());
       for (const auto& resource : removed_resources) {
         removed->push_back(resource);
       }
-      parent_.update(added_addresses, added_ids, removed);
+      parent_.update(added_addresses, added_ids, added_workloads, removed);
       return absl::OkStatus();
     }
     void onConfigUpdateFailed(Config::ConfigUpdateFailureReason, const EnvoyException*) override {
@@ -200,18 +305,22 @@ private:
     Config::SubscriptionPtr subscription_;
   };
 
-  void reset(AddressToWorkloadSharedPtr index) {
-    tls_.runOnAllThreads([index](OptRef<ThreadLocalProvider> tls) { tls->reset(index); });
+  void reset(AddressToWorkloadSharedPtr index, IdToWorkloadSharedPtr workloads) {
+    tls_.runOnAllThreads(
+        [index, workloads](OptRef<ThreadLocalProvider> tls) { tls->reset(index, workloads); });
     stats_.total_.set(tls_->total());
+    stats_.identities_.set(tls_->identities());
   }
 
   void update(const AddressToWorkloadSharedPtr& added_addresses,
-              const IdToAddressSharedPtr& added_ids,
+              const IdToAddressSharedPtr& added_ids, const IdToWorkloadSharedPtr& added_workloads,
               const std::shared_ptr<std::vector<std::string>> removed) {
-    tls_.runOnAllThreads([added_addresses, added_ids, removed](OptRef<ThreadLocalProvider> tls) {
-      tls->update(added_addresses, added_ids, removed);
-    });
+    tls_.runOnAllThreads(
+        [added_addresses, added_ids, added_workloads, removed](OptRef<ThreadLocalProvider> tls) {
+          tls->update(added_addresses, added_ids, added_workloads, removed);
+        });
     stats_.total_.set(tls_->total());
+    stats_.identities_.set(tls_->identities());
   }
 
   WorkloadDiscoveryStats generateStats(Stats::Scope& scope) {
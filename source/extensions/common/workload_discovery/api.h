@@ -21,7 +21,9 @@
 
 namespace Envoy::Extensions::Common::WorkloadDiscovery {
 
-#define WORKLOAD_DISCOVERY_STATS(GAUGE) GAUGE(total, NeverImport)
+#define WORKLOAD_DISCOVERY_STATS(GAUGE)                                                            \
+  GAUGE(total, NeverImport)                                                                        \
+  GAUGE(identities, NeverImport)
 
 struct WorkloadDiscoveryStats {
   WORKLOAD_DISCOVERY_STATS(GENERATE_GAUGE_STRUCT)
@@ -32,6 +34,16 @@ public:
   virtual ~WorkloadMetadataProvider() = default;
   virtual std::optional<Istio::Common::WorkloadMetadataObject>
   GetMetadata(const Network::Address::InstanceConstSharedPtr& address) PURE;
+  // Look up the workload by its SPIFFE identity, e.g. the URI SAN of the peer certificate. The
+  // returned object describes the workload rather than an instance, so the instance name is
+  // empty. Returns nothing if the identity is unknown or shared by several distinct workloads.
+  virtual std::optional<Istio::Common::WorkloadMetadataObject>
+  GetMetadataByIdentity(absl::string_view identity) PURE;
+  // Look up the workload by its UID, i.e. the xDS resource name.
+  virtual std::optional<Istio::Common::WorkloadMetadataObject>
+  GetMetadataByUid(absl::string_view uid) PURE;
+  // Returns true if the workload with the UID is known, without copying its metadata.
+  virtual bool HasUid(absl::string_view uid) PURE;
 };
 
 using WorkloadMetadataProviderSharedPtr = std::shared_ptr<WorkloadMetadataProvider>;
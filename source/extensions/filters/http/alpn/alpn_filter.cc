@@ -17,6 +17,7 @@
 
 #include "envoy/upstream/cluster_manager.h"
 #include "source/common/network/application_protocol.h"
+#include "extensions/common/cluster_metadata.h"
 
 namespace Envoy {
 namespace Http {
@@ -69,19 +70,11 @@ Http::FilterHeadersStatus AlpnFilter::decodeHeaders(Http::RequestHeaderMap&, boo
     return Http::FilterHeadersStatus::Continue;
   }
 
-  const auto& filter_metadata = cluster->info()->metadata().filter_metadata();
-  const auto& istio = filter_metadata.find("istio");
-  if (istio != filter_metadata.end()) {
-    const auto& alpn_override = istio->second.fields().find("alpn_override");
-    if (alpn_override != istio->second.fields().end()) {
-      const auto alpn_override_value = alpn_override->second.string_value();
-      if (alpn_override_value == "false") {
-        // Skip ALPN header rewrite
-        ENVOY_LOG(debug,
-                  "Skipping ALPN header rewrite because istio.alpn_override metadata is false");
-        return Http::FilterHeadersStatus::Continue;
-      }
-    }
+  const auto* digest = Istio::Common::ClusterMetadataDigest::get(*cluster->info());
+  if (digest != nullptr && digest->alpn_override_disabled_) {
+    // Skip ALPN header rewrite
+    ENVOY_LOG(debug, "Skipping ALPN header rewrite because istio.alpn_override metadata is false");
+    return Http::FilterHeadersStatus::Continue;
   }
 
   auto protocols =
@@ -0,0 +1,330 @@
+// Copyright Istio Authors. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#pragma once
+
+#include <array>
+#include <cmath>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "absl/container/flat_hash_map.h"
+#include "absl/container/flat_hash_set.h"
+#include "absl/numeric/bits.h"
+#include "absl/types/optional.h"
+#include "absl/synchronization/mutex.h"
+#include "envoy/stats/scope.h"
+#include "source/common/common/hash.h"
+#include "source/common/common/logger.h"
+#include "source/common/stats/symbol_table.h"
+#include "source/common/stats/utility.h"
+#include "source/extensions/filters/http/istio_stats/config.pb.h"
+#include "source/extensions/filters/http/istio_stats/context.h"
+
+namespace Envoy {
+namespace Extensions {
+namespace HttpFilters {
+namespace IstioStats {
+
+// HyperLogLog sketch of the distinct values of a tag. 1024 registers give a standard error of
+// about 3%.
+class HyperLogLog {
+public:
+  static constexpr uint32_t Precision = 10;
+  static constexpr uint32_t NumRegisters = 1 << Precision;
+
+  // Returns true if a register changed, so the estimate needs to be refreshed.
+  bool add(uint64_t hash) {
+    const uint32_t index = hash >> (64 - Precision);
+    const uint64_t rest = hash << Precision;
+    const uint8_t rank = std::min<int>(absl::countl_zero(rest), 64 - Precision) + 1;
+    if (rank <= registers_[index]) {
+      return false;
+    }
+    registers_[index] = rank;
+    return true;
+  }
+
+  uint64_t estimate() const {
+    constexpr double m = NumRegisters;
+    double sum = 0;
+    uint32_t zeros = 0;
+    for (const uint8_t rank : registers_) {
+      sum += std::ldexp(1.0, -rank);
+      if (rank == 0) {
+        zeros++;
+      }
+    }
+    double estimate = 0.7213 / (1 + 1.079 / m) * m * m / sum;
+    // Linear counting is more accurate for the small cardinalities.
+    if (estimate <= 2.5 * m && zeros > 0) {
+      estimate = m * std::log(m / zeros);
+    }
+    return std::llround(estimate);
+  }
+
+  void clear() { registers_.fill(0); }
+
+private:
+  std::array<uint8_t, NumRegisters> registers_{};
+};
+
+struct CardinalityLimits {
+  uint32_t max_series_{0};
+  uint32_t max_tag_values_{0};
+  absl::flat_hash_map<Stats::StatName, uint32_t> tag_limits_;
+
+  uint32_t maxTagValues(Stats::StatName tag) const {
+    const auto it = tag_limits_.find(tag);
+    return it != tag_limits_.end() ? it->second : max_tag_values_;
+  }
+};
+
+// Series cardinality budgets shared by the workers. The workers consult the limiter when they
+// resolve a metric handle that is not in their cache, so the lock is off the path of the steady
+// traffic and the overflow series are cached like any other. The budgets are reset on the scope
+// rotation, since the series of the previous scope expire with it. The series kept by the idle
+// eviction survive the rotation, so the new budgets are seeded with them.
+class CardinalityLimiter : public Logger::Loggable<Logger::Id::filter> {
+public:
+  CardinalityLimiter(const stats::PluginConfig& proto_config, Stats::Scope& scope,
+                     ContextSharedPtr context)
+      : context_(context), scope_(scope.getShared()), pool_(scope.symbolTable()) {
+    for (const auto& limit : proto_config.cardinality_limits()) {
+      CardinalityLimits limits;
+      limits.max_series_ = limit.max_series();
+      limits.max_tag_values_ = limit.max_tag_values();
+      for (const auto& [tag, max_values] : limit.tag_limits()) {
+        limits.tag_limits_[pool_.add(tag)] = max_values;
+      }
+      if (limit.name().empty()) {
+        default_limits_ = std::move(limits);
+      } else {
+        metric_limits_[pool_.add(absl::StrCat("istio_", limit.name()))] = std::move(limits);
+      }
+    }
+  }
+
+  // Replaces the tag values past the budgets with the overflow value.
+  void limit(uint64_t generation, Stats::StatName metric, Stats::StatNameTagVector& tags) {
+    const CardinalityLimits* limits = find(metric);
+    if (limits == nullptr) {
+      return;
+    }
+    Stats::SymbolTable& symbol_table = scope_->symbolTable();
+    absl::MutexLock lock(&mutex_);
+    reset(generation);
+    MetricState& state = metricState(metric);
+    for (auto& [name, value] : tags) {
+      const uint32_t max_values = limits->maxTagValues(name);
+      if (max_values == 0) {
+        continue;
+      }
+      TagState& tag = tagState(state, metric, name);
+      std::string value_string = symbol_table.toString(value);
+      if (tag.sketch_.add(HashUtil::xxHash64(value_string))) {
+        tag.distinct_values_->set(tag.sketch_.estimate());
+      }
+      if (tag.values_.contains(value_string)) {
+        continue;
+      }
+      if (tag.values_.size() < max_values) {
+        tag.values_.insert(std::move(value_string));
+        continue;
+      }
+      tag.overflow_->inc();
+      value = context_->overflow_;
+    }
+    if (limits->max_series_ == 0) {
+      return;
+    }
+    std::string series = seriesKey(tags);
+    if (state.series_.contains(series)) {
+      return;
+    }
+    if (state.series_.size() < limits->max_series_) {
+      state.series_.insert(std::move(series));
+      return;
+    }
+    if (state.series_overflow_ == nullptr) {
+      state.series_overflow_ = &Stats::Utility::counterFromElements(
+          *scope_, {context_->cardinality_, metric, context_->series_overflow_});
+    }
+    state.series_overflow_->inc();
+    for (auto& [_, value] : tags) {
+      value = context_->overflow_;
+    }
+  }
+
+  // Resets the budgets for the generation and charges them with the series of the scope, which
+  // the idle eviction kept from the previous generation. Main thread only, before the workers
+  // observe the generation.
+  void seed(uint64_t generation, Stats::Scope& scope) {
+    // The names and the tags are owned by the series, which the scope references.
+    std::vector<std::pair<Stats::StatName, Stats::StatNameTagVector>> kept;
+    const auto collect = [&kept](const Stats::Metric& series) {
+      Stats::StatNameTagVector tags;
+      series.iterateTagStatNames([&tags](Stats::StatName name, Stats::StatName value) {
+        tags.emplace_back(name, value);
+        return true;
+      });
+      kept.emplace_back(series.tagExtractedStatName(), std::move(tags));
+      return true;
+    };
+    scope.iterate(Stats::IterateFn<Stats::Counter>(
+        [&](const Stats::CounterSharedPtr& counter) { return collect(*counter); }));
+    scope.iterate(Stats::IterateFn<Stats::Gauge>(
+        [&](const Stats::GaugeSharedPtr& gauge) { return collect(*gauge); }));
+    scope.iterate(Stats::IterateFn<Stats::Histogram>(
+        [&](const Stats::HistogramSharedPtr& histogram) { return collect(*histogram); }));
+
+    Stats::SymbolTable& symbol_table = scope_->symbolTable();
+    absl::MutexLock lock(&mutex_);
+    reset(generation);
+    for (const auto& [name, tags] : kept) {
+      const auto it = names_.find(symbol_table.toString(name));
+      const CardinalityLimits* limits = it != names_.end() ? find(it->second) : nullptr;
+      if (limits == nullptr) {
+        continue;
+      }
+      const Stats::StatName metric = it->second;
+      MetricState& state = metricState(metric);
+      bool overflow = true;
+      for (const auto& [tag_name, value] : tags) {
+        if (value == context_->overflow_) {
+          continue;
+        }
+        overflow = false;
+        const uint32_t max_values = limits->maxTagValues(tag_name);
+        if (max_values == 0) {
+          continue;
+        }
+        TagState& tag = tagState(state, metric, tag_name);
+        std::string value_string = symbol_table.toString(value);
+        if (tag.sketch_.add(HashUtil::xxHash64(value_string))) {
+          tag.distinct_values_->set(tag.sketch_.estimate());
+        }
+        if (tag.values_.size() < max_values) {
+          tag.values_.insert(std::move(value_string));
+        }
+      }
+      // The series past the series budget carry the overflow value only.
+      if (limits->max_series_ > 0 && !overflow && state.series_.size() < limits->max_series_) {
+        state.series_.insert(seriesKey(tags));
+      }
+    }
+    ENVOY_LOG(debug, "Seeded the Istio stats cardinality budgets with {} kept series.",
+              kept.size());
+  }
+
+private:
+  struct TagState {
+    Stats::Gauge* distinct_values_;
+    Stats::Counter* overflow_;
+    HyperLogLog sketch_;
+    absl::flat_hash_set<std::string> values_;
+  };
+  struct MetricState {
+    void clear() {
+      for (auto& [_, tag] : tags_) {
+        tag.sketch_.clear();
+        tag.distinct_values_->set(0);
+        tag.values_.clear();
+      }
+      series_.clear();
+    }
+    absl::flat_hash_map<Stats::StatName, TagState> tags_;
+    absl::flat_hash_set<std::string> series_;
+    Stats::Counter* series_overflow_{nullptr};
+  };
+
+  void reset(uint64_t generation) ABSL_EXCLUSIVE_LOCKS_REQUIRED(mutex_) {
+    if (generation <= generation_) {
+      return;
+    }
+    for (auto& [_, state] : states_) {
+      state.clear();
+    }
+    generation_ = generation;
+  }
+
+  // The kept series are named after the metric in the stat namespace, so the state records the
+  // name to find the metric when seeding.
+  MetricState& metricState(Stats::StatName metric) ABSL_EXCLUSIVE_LOCKS_REQUIRED(mutex_) {
+    const auto it = states_.find(metric);
+    if (it != states_.end()) {
+      return it->second;
+    }
+    const Stats::SymbolTable& symbol_table = scope_->symbolTable();
+    names_.emplace(absl::StrCat(symbol_table.toString(context_->stat_namespace_), ".",
+                                symbol_table.toString(metric)),
+                   metric);
+    return states_[metric];
+  }
+
+  std::string seriesKey(const Stats::StatNameTagVector& tags) const {
+    const Stats::SymbolTable& symbol_table = scope_->symbolTable();
+    std::string series;
+    for (const auto& [_, value] : tags) {
+      const std::string value_string = symbol_table.toString(value);
+      const uint32_t size = value_string.size();
+      series.append(reinterpret_cast<const char*>(&size), sizeof(size));
+      series.append(value_string);
+    }
+    return series;
+  }
+
+  const CardinalityLimits* find(Stats::StatName metric) const {
+    const auto it = metric_limits_.find(metric);
+    if (it != metric_limits_.end()) {
+      return &it->second;
+    }
+    return default_limits_.has_value() ? &default_limits_.value() : nullptr;
+  }
+
+  TagState& tagState(MetricState& state, Stats::StatName metric, Stats::StatName name)
+      ABSL_EXCLUSIVE_LOCKS_REQUIRED(mutex_) {
+    const auto it = state.tags_.find(name);
+    if (it != state.tags_.end()) {
+      return it->second;
+    }
+    TagState& tag = state.tags_[name];
+    tag.distinct_values_ = &Stats::Utility::gaugeFromElements(
+        *scope_, {context_->cardinality_, metric, name, context_->distinct_values_},
+        Stats::Gauge::ImportMode::NeverImport);
+    tag.overflow_ = &Stats::Utility::counterFromElements(
+        *scope_, {context_->cardinality_, metric, name, context_->overflow_});
+    return tag;
+  }
+
+  ContextSharedPtr context_;
+  // The stats outlive the listener scope if a worker cache is released after the configuration.
+  Stats::ScopeSharedPtr scope_;
+  Stats::StatNamePool pool_;
+  absl::optional<CardinalityLimits> default_limits_;
+  absl::flat_hash_map<Stats::StatName, CardinalityLimits> metric_limits_;
+
+  absl::Mutex mutex_;
+  uint64_t generation_ ABSL_GUARDED_BY(mutex_){0};
+  absl::flat_hash_map<Stats::StatName, MetricState> states_ ABSL_GUARDED_BY(mutex_);
+  absl::flat_hash_map<std::string, Stats::StatName> names_ ABSL_GUARDED_BY(mutex_);
+};
+
+using CardinalityLimiterSharedPtr = std::shared_ptr<CardinalityLimiter>;
+
+} // namespace IstioStats
+} // namespace HttpFilters
+} // namespace Extensions
+} // namespace Envoy
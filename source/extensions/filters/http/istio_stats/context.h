@@ -0,0 +1,341 @@
+// Copyright Istio Authors. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#pragma once
+
+#include <array>
+#include <memory>
+#include <string>
+
+#include "absl/container/flat_hash_map.h"
+#include "absl/strings/str_cat.h"
+#include "absl/synchronization/mutex.h"
+#include "envoy/local_info/local_info.h"
+#include "envoy/singleton/instance.h"
+#include "envoy/stream_info/stream_info.h"
+#include "extensions/common/metadata_object.h"
+#include "source/common/protobuf/protobuf.h"
+#include "source/common/stats/symbol_table.h"
+#include "source/common/stream_info/utility.h"
+
+namespace Envoy {
+namespace Extensions {
+namespace HttpFilters {
+namespace IstioStats {
+
+constexpr absl::string_view CustomStatNamespace = "istiocustom";
+
+inline absl::string_view extractString(const ProtobufWkt::Struct& metadata, absl::string_view key) {
+  const auto& it = metadata.fields().find(key);
+  if (it == metadata.fields().end()) {
+    return {};
+  }
+  return it->second.string_value();
+}
+
+inline absl::string_view extractMapString(const ProtobufWkt::Struct& metadata,
+                                          const std::string& map_key, absl::string_view key) {
+  const auto& it = metadata.fields().find(map_key);
+  if (it == metadata.fields().end()) {
+    return {};
+  }
+  return extractString(it->second.struct_value(), key);
+}
+
+// Process-wide context shared with all filter instances.
+struct Context : public Singleton::Instance {
+  explicit Context(Stats::SymbolTable& symbol_table, const LocalInfo::LocalInfo& local_info)
+      : pool_(symbol_table), local_info_(local_info),
+        stat_namespace_(pool_.add(CustomStatNamespace)),
+        requests_total_(pool_.add("istio_requests_total")),
+        request_duration_milliseconds_(pool_.add("istio_request_duration_milliseconds")),
+        request_bytes_(pool_.add("istio_request_bytes")),
+        response_bytes_(pool_.add("istio_response_bytes")),
+        request_messages_total_(pool_.add("istio_request_messages_total")),
+        response_messages_total_(pool_.add("istio_response_messages_total")),
+        tcp_connections_opened_total_(pool_.add("istio_tcp_connections_opened_total")),
+        tcp_connections_closed_total_(pool_.add("istio_tcp_connections_closed_total")),
+        tcp_sent_bytes_total_(pool_.add("istio_tcp_sent_bytes_total")),
+        tcp_received_bytes_total_(pool_.add("istio_tcp_received_bytes_total")),
+        downstream_request_duration_milliseconds_(
+            pool_.add("istio_downstream_request_duration_milliseconds")),
+        upstream_connection_duration_milliseconds_(
+            pool_.add("istio_upstream_connection_duration_milliseconds")),
+        upstream_request_duration_milliseconds_(
+            pool_.add("istio_upstream_request_duration_milliseconds")),
+        upstream_service_duration_milliseconds_(
+            pool_.add("istio_upstream_service_duration_milliseconds")),
+        upstream_response_duration_milliseconds_(
+            pool_.add("istio_upstream_response_duration_milliseconds")),
+        downstream_response_duration_milliseconds_(
+            pool_.add("istio_downstream_response_duration_milliseconds")),
+        empty_(pool_.add("")), unknown_(pool_.add("unknown")), source_(pool_.add("source")),
+        destination_(pool_.add("destination")), latest_(pool_.add("latest")),
+        http_(pool_.add("http")), grpc_(pool_.add("grpc")), tcp_(pool_.add("tcp")),
+        mutual_tls_(pool_.add("mutual_tls")), none_(pool_.add("none")),
+        reporter_(pool_.add("reporter")), source_workload_(pool_.add("source_workload")),
+        source_workload_namespace_(pool_.add("source_workload_namespace")),
+        source_principal_(pool_.add("source_principal")), source_app_(pool_.add("source_app")),
+        source_version_(pool_.add("source_version")),
+        source_canonical_service_(pool_.add("source_canonical_service")),
+        source_canonical_revision_(pool_.add("source_canonical_revision")),
+        source_cluster_(pool_.add("source_cluster")),
+        destination_workload_(pool_.add("destination_workload")),
+        destination_workload_namespace_(pool_.add("destination_workload_namespace")),
+        destination_principal_(pool_.add("destination_principal")),
+        destination_app_(pool_.add("destination_app")),
+        destination_version_(pool_.add("destination_version")),
+        destination_service_(pool_.add("destination_service")),
+        destination_service_name_(pool_.add("destination_service_name")),
+        destination_service_namespace_(pool_.add("destination_service_namespace")),
+        destination_canonical_service_(pool_.add("destination_canonical_service")),
+        destination_canonical_revision_(pool_.add("destination_canonical_revision")),
+        destination_cluster_(pool_.add("destination_cluster")),
+        request_protocol_(pool_.add("request_protocol")),
+        response_flags_(pool_.add("response_flags")),
+        connection_security_policy_(pool_.add("connection_security_policy")),
+        response_code_(pool_.add("response_code")),
+        grpc_response_status_(pool_.add("grpc_response_status")),
+        workload_name_(pool_.add(extractString(local_info.node().metadata(), "WORKLOAD_NAME"))),
+        namespace_(pool_.add(extractString(local_info.node().metadata(), "NAMESPACE"))),
+        canonical_name_(pool_.add(extractMapString(local_info.node().metadata(), "LABELS",
+                                                   Istio::Common::CanonicalNameLabel))),
+        canonical_revision_(pool_.add(extractMapString(local_info.node().metadata(), "LABELS",
+                                                       Istio::Common::CanonicalRevisionLabel))),
+        app_name_(pool_.add(
+            extractMapString(local_info.node().metadata(), "LABELS", Istio::Common::AppNameLabel))),
+        app_version_(pool_.add(extractMapString(local_info.node().metadata(), "LABELS",
+                                                Istio::Common::AppVersionLabel))),
+        cluster_name_(pool_.add(extractString(local_info.node().metadata(), "CLUSTER_ID"))),
+        waypoint_(pool_.add("waypoint")), istio_build_(pool_.add("istio_build")),
+        component_(pool_.add("component")), proxy_(pool_.add("proxy")), tag_(pool_.add("tag")),
+        istio_version_(pool_.add(extractString(local_info.node().metadata(), "ISTIO_VERSION"))),
+        counter_flush_duration_(pool_.add("istio_stats.counter_flush_duration_us")),
+        overflow_(pool_.add("overflow")), cardinality_(pool_.add("istio_stats.cardinality")),
+        distinct_values_(pool_.add("distinct_values")),
+        series_overflow_(pool_.add("series_overflow")),
+        histogram_sample_rate_(pool_.add("istio_stats.histogram_sample_rate")),
+        no_response_flags_(pool_.add("-")), response_flags_pool_(symbol_table) {
+    all_metrics_ = {
+        {"requests_total", requests_total_},
+        {"request_duration_milliseconds", request_duration_milliseconds_},
+        {"request_bytes", request_bytes_},
+        {"response_bytes", response_bytes_},
+        {"request_messages_total", request_messages_total_},
+        {"response_messages_total", response_messages_total_},
+        {"tcp_connections_opened_total", tcp_connections_opened_total_},
+        {"tcp_connections_closed_total", tcp_connections_closed_total_},
+        {"tcp_sent_bytes_total", tcp_sent_bytes_total_},
+        {"tcp_received_bytes_total", tcp_received_bytes_total_},
+        {"downstream_request_duration_milliseconds", downstream_request_duration_milliseconds_},
+        {"upstream_connection_duration_milliseconds", upstream_connection_duration_milliseconds_},
+        {"upstream_request_duration_milliseconds", upstream_request_duration_milliseconds_},
+        {"upstream_service_duration_milliseconds", upstream_service_duration_milliseconds_},
+        {"upstream_response_duration_milliseconds", upstream_response_duration_milliseconds_},
+        {"downstream_response_duration_milliseconds", downstream_response_duration_milliseconds_},
+    };
+    all_tags_ = {
+        {"reporter", reporter_},
+        {"source_workload", source_workload_},
+        {"source_workload_namespace", source_workload_namespace_},
+        {"source_principal", source_principal_},
+        {"source_app", source_app_},
+        {"source_version", source_version_},
+        {"source_canonical_service", source_canonical_service_},
+        {"source_canonical_revision", source_canonical_revision_},
+        {"source_cluster", source_cluster_},
+        {"destination_workload", destination_workload_},
+        {"destination_workload_namespace", destination_workload_namespace_},
+        {"destination_principal", destination_principal_},
+        {"destination_app", destination_app_},
+        {"destination_version", destination_version_},
+        {"destination_service", destination_service_},
+        {"destination_service_name", destination_service_name_},
+        {"destination_service_namespace", destination_service_namespace_},
+        {"destination_canonical_service", destination_canonical_service_},
+        {"destination_canonical_revision", destination_canonical_revision_},
+        {"destination_cluster", destination_cluster_},
+        {"request_protocol", request_protocol_},
+        {"response_flags", response_flags_},
+        {"connection_security_policy", connection_security_policy_},
+        {"response_code", response_code_},
+        {"grpc_response_status", grpc_response_status_},
+    };
+    for (size_t code = 0; code < response_codes_.size(); code++) {
+      response_codes_[code] = pool_.add(absl::StrCat(code));
+    }
+    for (size_t status = 0; status < grpc_statuses_.size(); status++) {
+      grpc_statuses_[status] = pool_.add(absl::StrCat(status));
+    }
+  }
+
+  // Returns an empty name for the codes outside of the table.
+  Stats::StatName responseCode(uint64_t code) const {
+    return code < response_codes_.size() ? response_codes_[code] : Stats::StatName();
+  }
+  Stats::StatName grpcStatus(uint64_t status) const {
+    return status < grpc_statuses_.size() ? grpc_statuses_[status] : Stats::StatName();
+  }
+
+  // Interns the response flag combinations on first use. Returns an empty name once the cache is
+  // full.
+  Stats::StatName responseFlags(const StreamInfo::StreamInfo& info) {
+    const auto flags = info.responseFlags();
+    if (flags.empty()) {
+      return no_response_flags_;
+    }
+    // Fits the small string buffer for the common combinations.
+    std::string key;
+    for (const auto flag : flags) {
+      const uint16_t value = flag.value();
+      key.append(reinterpret_cast<const char*>(&value), sizeof(value));
+    }
+    {
+      absl::ReaderMutexLock lock(&response_flags_mutex_);
+      const auto it = response_flags_.find(key);
+      if (it != response_flags_.end()) {
+        return it->second;
+      }
+    }
+    absl::MutexLock lock(&response_flags_mutex_);
+    const auto it = response_flags_.find(key);
+    if (it != response_flags_.end()) {
+      return it->second;
+    }
+    if (response_flags_.size() >= MaxResponseFlags) {
+      return Stats::StatName();
+    }
+    const Stats::StatName name =
+        response_flags_pool_.add(StreamInfo::ResponseFlagUtils::toShortString(info));
+    response_flags_.emplace(std::move(key), name);
+    return name;
+  }
+
+  Stats::StatNamePool pool_;
+  const LocalInfo::LocalInfo& local_info_;
+  absl::flat_hash_map<std::string, Stats::StatName> all_metrics_;
+  absl::flat_hash_map<std::string, Stats::StatName> all_tags_;
+
+  // Metric names.
+  const Stats::StatName stat_namespace_;
+  const Stats::StatName requests_total_;
+  const Stats::StatName request_duration_milliseconds_;
+  const Stats::StatName request_bytes_;
+  const Stats::StatName response_bytes_;
+  const Stats::StatName request_messages_total_;
+  const Stats::StatName response_messages_total_;
+  const Stats::StatName tcp_connections_opened_total_;
+  const Stats::StatName tcp_connections_closed_total_;
+  const Stats::StatName tcp_sent_bytes_total_;
+  const Stats::StatName tcp_received_bytes_total_;
+  const Stats::StatName downstream_request_duration_milliseconds_;
+  const Stats::StatName upstream_connection_duration_milliseconds_;
+  const Stats::StatName upstream_request_duration_milliseconds_;
+  const Stats::StatName upstream_service_duration_milliseconds_;
+  const Stats::StatName upstream_response_duration_milliseconds_;
+  const Stats::StatName downstream_response_duration_milliseconds_;
+
+  // Constant names.
+  const Stats::StatName empty_;
+  const Stats::StatName unknown_;
+  const Stats::StatName source_;
+  const Stats::StatName destination_;
+  const Stats::StatName latest_;
+  const Stats::StatName http_;
+  const Stats::StatName grpc_;
+  const Stats::StatName tcp_;
+  const Stats::StatName mutual_tls_;
+  const Stats::StatName none_;
+
+  // Tag names.
+  const Stats::StatName reporter_;
+
+  const Stats::StatName source_workload_;
+  const Stats::StatName source_workload_namespace_;
+  const Stats::StatName source_principal_;
+  const Stats::StatName source_app_;
+  const Stats::StatName source_version_;
+  const Stats::StatName source_canonical_service_;
+  const Stats::StatName source_canonical_revision_;
+  const Stats::StatName source_cluster_;
+
+  const Stats::StatName destination_workload_;
+  const Stats::StatName destination_workload_namespace_;
+  const Stats::StatName destination_principal_;
+  const Stats::StatName destination_app_;
+  const Stats::StatName destination_version_;
+  const Stats::StatName destination_service_;
+  const Stats::StatName destination_service_name_;
+  const Stats::StatName destination_service_namespace_;
+  const Stats::StatName destination_canonical_service_;
+  const Stats::StatName destination_canonical_revision_;
+  const Stats::StatName destination_cluster_;
+
+  const Stats::StatName request_protocol_;
+  const Stats::StatName response_flags_;
+  const Stats::StatName connection_security_policy_;
+  const Stats::StatName response_code_;
+  const Stats::StatName grpc_response_status_;
+
+  // Per-process constants.
+  const Stats::StatName workload_name_;
+  const Stats::StatName namespace_;
+  const Stats::StatName canonical_name_;
+  const Stats::StatName canonical_revision_;
+  const Stats::StatName app_name_;
+  const Stats::StatName app_version_;
+  const Stats::StatName cluster_name_;
+  const Stats::StatName waypoint_;
+
+  // istio_build metric:
+  // Publishes Istio version for the proxy as a gauge, sample data:
+  // testdata/metric/istio_build.yaml
+  // Sample value for istio_version: "1.17.0"
+  const Stats::StatName istio_build_;
+  const Stats::StatName component_;
+  const Stats::StatName proxy_;
+  const Stats::StatName tag_;
+  const Stats::StatName istio_version_;
+
+  // Self-observability of the counter aggregation.
+  const Stats::StatName counter_flush_duration_;
+
+  // Cardinality limits.
+  const Stats::StatName overflow_;
+  const Stats::StatName cardinality_;
+  const Stats::StatName distinct_values_;
+  const Stats::StatName series_overflow_;
+
+  // Histogram sampling.
+  const Stats::StatName histogram_sample_rate_;
+
+  // Tag values of the bounded domains, indexed by the value.
+  std::array<Stats::StatName, 600> response_codes_;
+  std::array<Stats::StatName, 17> grpc_statuses_;
+
+  // Bounds the combinations of the response flags, which are few in practice.
+  static constexpr size_t MaxResponseFlags = 1024;
+  const Stats::StatName no_response_flags_;
+  absl::Mutex response_flags_mutex_;
+  Stats::StatNamePool response_flags_pool_ ABSL_GUARDED_BY(response_flags_mutex_);
+  absl::flat_hash_map<std::string, Stats::StatName>
+      response_flags_ ABSL_GUARDED_BY(response_flags_mutex_);
+};
+
+using ContextSharedPtr = std::shared_ptr<Context>;
+
+} // namespace IstioStats
+} // namespace HttpFilters
+} // namespace Extensions
+} // namespace Envoy
@@ -0,0 +1,185 @@
+// Copyright Istio Authors. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#pragma once
+
+#include <algorithm>
+#include <memory>
+#include <string>
+
+#include "absl/container/flat_hash_map.h"
+#include "absl/strings/numbers.h"
+#include "absl/strings/str_cat.h"
+#include "envoy/singleton/instance.h"
+#include "envoy/stats/scope.h"
+#include "envoy/stats/stats_macros.h"
+#include "parser/parser.h"
+#include "source/common/common/logger.h"
+#include "source/extensions/filters/common/expr/evaluator.h"
+
+#if defined(__GNUC__)
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wunused-parameter"
+#endif
+
+#include "eval/public/builtin_func_registrar.h"
+#include "eval/public/cel_expr_builder_factory.h"
+
+#if defined(__GNUC__)
+#pragma GCC diagnostic pop
+#endif
+
+namespace Envoy {
+namespace Extensions {
+namespace HttpFilters {
+namespace IstioStats {
+
+#define EXPRESSION_CACHE_STATS(COUNTER, GAUGE)                                                     \
+  COUNTER(hit)                                                                                     \
+  COUNTER(miss)                                                                                    \
+  GAUGE(size, NeverImport)
+
+struct ExpressionCacheStats {
+  EXPRESSION_CACHE_STATS(GENERATE_COUNTER_STRUCT, GENERATE_GAUGE_STRUCT)
+};
+
+// Parsed and compiled expression, immutable and shared by the configurations.
+struct CompiledExpression {
+  // The compiled expression uses the function registry of the builder.
+  std::shared_ptr<google::api::expr::runtime::CelExpressionBuilder> builder_;
+  google::api::expr::v1alpha1::Expr parsed_;
+  Filters::Common::Expr::ExpressionPtr expression_;
+};
+
+using CompiledExpressionSharedPtr = std::shared_ptr<const CompiledExpression>;
+
+// Process-wide cache of the compiled expressions, keyed by the expression text since all the
+// expressions are compiled with the same builder options. The listeners commonly carry the same
+// expressions, and the builder with the built-in functions is only created once. The cache holds
+// weak references, so an expression is released with its last configuration. Only accessed on
+// the main thread.
+class ExpressionCache : public Singleton::Instance {
+public:
+  explicit ExpressionCache(Stats::Scope& scope)
+      : stats_{EXPRESSION_CACHE_STATS(POOL_COUNTER_PREFIX(scope, "istio_stats.expression_cache."),
+                                      POOL_GAUGE_PREFIX(scope, "istio_stats.expression_cache."))} {}
+
+  // Returns nullptr if the expression does not parse.
+  CompiledExpressionSharedPtr getOrCreate(const std::string& text) {
+    const auto it = expressions_.find(text);
+    if (it != expressions_.end()) {
+      CompiledExpressionSharedPtr expression = it->second.lock();
+      if (expression) {
+        stats_.hit_.inc();
+        return expression;
+      }
+    }
+    stats_.miss_.inc();
+    auto parse_status = google::api::expr::parser::Parse(text);
+    if (!parse_status.ok()) {
+      return nullptr;
+    }
+    if (builder_ == nullptr) {
+      google::api::expr::runtime::InterpreterOptions options;
+      builder_ = google::api::expr::runtime::CreateCelExpressionBuilder(options);
+      auto register_status = google::api::expr::runtime::RegisterBuiltinFunctions(
+          builder_->GetRegistry(), options);
+      if (!register_status.ok()) {
+        builder_.reset();
+        throw Extensions::Filters::Common::Expr::CelException(
+            absl::StrCat("failed to register built-in functions: ", register_status.message()));
+      }
+    }
+    auto expression = std::make_shared<CompiledExpression>();
+    expression->builder_ = builder_;
+    expression->parsed_ = parse_status.value().expr();
+    expression->expression_ =
+        Extensions::Filters::Common::Expr::createExpression(*builder_, expression->parsed_);
+    // The expired entries are swept when the map doubles, so that the sweeps are amortized over
+    // the misses.
+    if (expressions_.size() >= sweep_size_) {
+      absl::erase_if(expressions_, [](const auto& it) { return it.second.expired(); });
+      sweep_size_ = std::max(2 * expressions_.size(), MinSweepSize);
+    }
+    expressions_[text] = expression;
+    stats_.size_.set(expressions_.size());
+    return expression;
+  }
+
+private:
+  static constexpr size_t MinSweepSize = 64;
+
+  ExpressionCacheStats stats_;
+  size_t sweep_size_{MinSweepSize};
+  std::shared_ptr<google::api::expr::runtime::CelExpressionBuilder> builder_;
+  absl::flat_hash_map<std::string, std::weak_ptr<const CompiledExpression>> expressions_;
+};
+
+using ExpressionCacheSharedPtr = std::shared_ptr<ExpressionCache>;
+
+using google::api::expr::runtime::CelValue;
+
+// Converts the metric value expression result. Matches parsing the printed value as an integer,
+// without the string round trip for the common types.
+inline uint64_t celValueToAmount(const CelValue& value) {
+  uint64_t amount = 0;
+  switch (value.type()) {
+  case CelValue::Type::kInt64:
+    // Negative values do not parse as unsigned.
+    if (value.Int64OrDie() >= 0) {
+      amount = value.Int64OrDie();
+    }
+    break;
+  case CelValue::Type::kUint64:
+    amount = value.Uint64OrDie();
+    break;
+  case CelValue::Type::kString:
+    if (!absl::SimpleAtoi(value.StringOrDie().value(), &amount)) {
+      ENVOY_LOG_MISC(trace, "Failed to get metric value: {}", value.StringOrDie().value());
+    }
+    break;
+  default: {
+    const auto string_value = Filters::Common::Expr::print(value);
+    if (!absl::SimpleAtoi(string_value, &amount)) {
+      ENVOY_LOG_MISC(trace, "Failed to get metric value: {}", string_value);
+    }
+    break;
+  }
+  }
+  return amount;
+}
+
+// Converts the dimension expression result. Matches interning the printed value, without the
+// string copy for the common types.
+template <class Pool> Stats::StatName celValueToTag(const CelValue& value, Pool& pool) {
+  switch (value.type()) {
+  case CelValue::Type::kString:
+    return pool.add(value.StringOrDie().value());
+  case CelValue::Type::kBytes:
+    return pool.add(value.BytesOrDie().value());
+  case CelValue::Type::kBool:
+    return pool.add(value.BoolOrDie() ? "true" : "false");
+  case CelValue::Type::kInt64:
+    return pool.add(absl::AlphaNum(value.Int64OrDie()).Piece());
+  case CelValue::Type::kUint64:
+    return pool.add(absl::AlphaNum(value.Uint64OrDie()).Piece());
+  default:
+    return pool.add(Filters::Common::Expr::print(value));
+  }
+}
+
+} // namespace IstioStats
+} // namespace HttpFilters
+} // namespace Extensions
+} // namespace Envoy
@@ -14,35 +14,46 @@
 
 #include "source/extensions/filters/http/istio_stats/istio_stats.h"
 
-#include <atomic>
-
+#include <array>
+#include <limits>
+#include <list>
+#include <tuple>
+#include <type_traits>
+
+#include "absl/container/inlined_vector.h"
+#include "absl/strings/str_split.h"
+#include "absl/strings/strip.h"
 #include "envoy/router/string_accessor.h"
 #include "envoy/registry/registry.h"
 #include "envoy/server/factory_context.h"
 #include "envoy/singleton/manager.h"
+#include "envoy/stats/stats_macros.h"
+#include "envoy/thread_local/thread_local.h"
+#include "envoy/upstream/cluster_manager.h"
+#include "extensions/common/cluster_metadata.h"
 #include "extensions/common/metadata_object.h"
-#include "parser/parser.h"
+#include "opentelemetry/proto/collector/metrics/v1/metrics_service.pb.h"
 #include "source/common/grpc/common.h"
+#include "source/common/grpc/typed_async_client.h"
 #include "source/common/http/header_map_impl.h"
 #include "source/common/http/header_utility.h"
 #include "source/common/network/utility.h"
+#include "source/common/protobuf/utility.h"
 #include "source/common/stream_info/utility.h"
+#include "source/common/tracing/null_span_impl.h"
 #include "source/extensions/filters/common/expr/context.h"
 #include "source/extensions/filters/common/expr/evaluator.h"
 #include "source/extensions/filters/http/common/pass_through_filter.h"
 #include "source/extensions/filters/http/grpc_stats/grpc_stats_filter.h"
-
-#if defined(__GNUC__)
-#pragma GCC diagnostic push
-#pragma GCC diagnostic ignored "-Wunused-parameter"
-#endif
-
-#include "eval/public/builtin_func_registrar.h"
-#include "eval/public/cel_expr_builder_factory.h"
-
-#if defined(__GNUC__)
-#pragma GCC diagnostic pop
-#endif
+#include "source/extensions/filters/http/istio_stats/cardinality_limiter.h"
+#include "source/extensions/filters/http/istio_stats/context.h"
+#include "source/extensions/filters/http/istio_stats/expression_cache.h"
+#include "source/extensions/filters/http/istio_stats/metric_cache.h"
+#include "source/extensions/filters/http/istio_stats/metric_overrides.h"
+#include "source/extensions/filters/http/istio_stats/report_wheel.h"
+#include "source/extensions/filters/http/istio_stats/rotating_scope.h"
+#include "source/extensions/filters/http/istio_stats/self_telemetry.h"
+#include "source/extensions/filters/http/istio_stats/tag_value_table.h"
 
 namespace Envoy {
 namespace Extensions {
@@ -67,25 +78,6 @@ absl::optional<absl::string_view> getNamespace(absl::string_view principal) {
   return {principal.substr(begin, len)};
 }
 
-constexpr absl::string_view CustomStatNamespace = "istiocustom";
-
-absl::string_view extractString(const ProtobufWkt::Struct& metadata, absl::string_view key) {
-  const auto& it = metadata.fields().find(key);
-  if (it == metadata.fields().end()) {
-    return {};
-  }
-  return it->second.string_value();
-}
-
-absl::string_view extractMapString(const ProtobufWkt::Struct& metadata, const std::string& map_key,
-                                   absl::string_view key) {
-  const auto& it = metadata.fields().find(map_key);
-  if (it == metadata.fields().end()) {
-    return {};
-  }
-  return extractString(it->second.struct_value(), key);
-}
-
 absl::optional<Istio::Common::WorkloadMetadataObject>
 extractEndpointMetadata(const StreamInfo::StreamInfo& info) {
   auto upstream_info = info.upstreamInfo();
@@ -124,396 +116,833 @@ bool peerInfoRead(Reporter reporter, const StreamInfo::FilterState& filter_state
 
 const Istio::Common::WorkloadMetadataObject* peerInfo(Reporter reporter,
                                                       const StreamInfo::FilterState& filter_state) {
-  const auto& filter_state_key =
-      reporter == Reporter::ServerSidecar || reporter == Reporter::ServerGateway
-          ? Istio::Common::DownstreamPeer
-          : Istio::Common::UpstreamPeer;
-  return filter_state.getDataReadOnly<Istio::Common::WorkloadMetadataObject>(filter_state_key);
+  if (reporter == Reporter::ServerSidecar || reporter == Reporter::ServerGateway) {
+    const auto* object = filter_state.getDataReadOnly<Istio::Common::WorkloadMetadataObject>(
+        Istio::Common::DownstreamPeer);
+    // Fall back to the peer resolved by the listener filter when the connection was accepted.
+    return object ? object
+                  : filter_state.getDataReadOnly<Istio::Common::WorkloadMetadataObject>(
+                        Istio::Common::ConnectionPeer);
+  }
+  return filter_state.getDataReadOnly<Istio::Common::WorkloadMetadataObject>(
+      Istio::Common::UpstreamPeer);
 }
 
-// Process-wide context shared with all filter instances.
-struct Context : public Singleton::Instance {
-  explicit Context(Stats::SymbolTable& symbol_table, const LocalInfo::LocalInfo& local_info)
-      : pool_(symbol_table), local_info_(local_info),
-        stat_namespace_(pool_.add(CustomStatNamespace)),
-        requests_total_(pool_.add("istio_requests_total")),
-        request_duration_milliseconds_(pool_.add("istio_request_duration_milliseconds")),
-        request_bytes_(pool_.add("istio_request_bytes")),
-        response_bytes_(pool_.add("istio_response_bytes")),
-        request_messages_total_(pool_.add("istio_request_messages_total")),
-        response_messages_total_(pool_.add("istio_response_messages_total")),
-        tcp_connections_opened_total_(pool_.add("istio_tcp_connections_opened_total")),
-        tcp_connections_closed_total_(pool_.add("istio_tcp_connections_closed_total")),
-        tcp_sent_bytes_total_(pool_.add("istio_tcp_sent_bytes_total")),
-        tcp_received_bytes_total_(pool_.add("istio_tcp_received_bytes_total")),
-        empty_(pool_.add("")), unknown_(pool_.add("unknown")), source_(pool_.add("source")),
-        destination_(pool_.add("destination")), latest_(pool_.add("latest")),
-        http_(pool_.add("http")), grpc_(pool_.add("grpc")), tcp_(pool_.add("tcp")),
-        mutual_tls_(pool_.add("mutual_tls")), none_(pool_.add("none")),
-        reporter_(pool_.add("reporter")), source_workload_(pool_.add("source_workload")),
-        source_workload_namespace_(pool_.add("source_workload_namespace")),
-        source_principal_(pool_.add("source_principal")), source_app_(pool_.add("source_app")),
-        source_version_(pool_.add("source_version")),
-        source_canonical_service_(pool_.add("source_canonical_service")),
-        source_canonical_revision_(pool_.add("source_canonical_revision")),
-        source_cluster_(pool_.add("source_cluster")),
-        destination_workload_(pool_.add("destination_workload")),
-        destination_workload_namespace_(pool_.add("destination_workload_namespace")),
-        destination_principal_(pool_.add("destination_principal")),
-        destination_app_(pool_.add("destination_app")),
-        destination_version_(pool_.add("destination_version")),
-        destination_service_(pool_.add("destination_service")),
-        destination_service_name_(pool_.add("destination_service_name")),
-        destination_service_namespace_(pool_.add("destination_service_namespace")),
-        destination_canonical_service_(pool_.add("destination_canonical_service")),
-        destination_canonical_revision_(pool_.add("destination_canonical_revision")),
-        destination_cluster_(pool_.add("destination_cluster")),
-        request_protocol_(pool_.add("request_protocol")),
-        response_flags_(pool_.add("response_flags")),
-        connection_security_policy_(pool_.add("connection_security_policy")),
-        response_code_(pool_.add("response_code")),
-        grpc_response_status_(pool_.add("grpc_response_status")),
-        workload_name_(pool_.add(extractString(local_info.node().metadata(), "WORKLOAD_NAME"))),
-        namespace_(pool_.add(extractString(local_info.node().metadata(), "NAMESPACE"))),
-        canonical_name_(pool_.add(extractMapString(local_info.node().metadata(), "LABELS",
-                                                   Istio::Common::CanonicalNameLabel))),
-        canonical_revision_(pool_.add(extractMapString(local_info.node().metadata(), "LABELS",
-                                                       Istio::Common::CanonicalRevisionLabel))),
-        app_name_(pool_.add(
-            extractMapString(local_info.node().metadata(), "LABELS", Istio::Common::AppNameLabel))),
-        app_version_(pool_.add(extractMapString(local_info.node().metadata(), "LABELS",
-                                                Istio::Common::AppVersionLabel))),
-        cluster_name_(pool_.add(extractString(local_info.node().metadata(), "CLUSTER_ID"))),
-        waypoint_(pool_.add("waypoint")), istio_build_(pool_.add("istio_build")),
-        component_(pool_.add("component")), proxy_(pool_.add("proxy")), tag_(pool_.add("tag")),
-        istio_version_(pool_.add(extractString(local_info.node().metadata(), "ISTIO_VERSION"))) {
-    all_metrics_ = {
-        {"requests_total", requests_total_},
-        {"request_duration_milliseconds", request_duration_milliseconds_},
-        {"request_bytes", request_bytes_},
-        {"response_bytes", response_bytes_},
-        {"request_messages_total", request_messages_total_},
-        {"response_messages_total", response_messages_total_},
-        {"tcp_connections_opened_total", tcp_connections_opened_total_},
-        {"tcp_connections_closed_total", tcp_connections_closed_total_},
-        {"tcp_sent_bytes_total", tcp_sent_bytes_total_},
-        {"tcp_received_bytes_total", tcp_received_bytes_total_},
-    };
-    all_tags_ = {
-        {"reporter", reporter_},
-        {"source_workload", source_workload_},
-        {"source_workload_namespace", source_workload_namespace_},
-        {"source_principal", source_principal_},
-        {"source_app", source_app_},
-        {"source_version", source_version_},
-        {"source_canonical_service", source_canonical_service_},
-        {"source_canonical_revision", source_canonical_revision_},
-        {"source_cluster", source_cluster_},
-        {"destination_workload", destination_workload_},
-        {"destination_workload_namespace", destination_workload_namespace_},
-        {"destination_principal", destination_principal_},
-        {"destination_app", destination_app_},
-        {"destination_version", destination_version_},
-        {"destination_service", destination_service_},
-        {"destination_service_name", destination_service_name_},
-        {"destination_service_namespace", destination_service_namespace_},
-        {"destination_canonical_service", destination_canonical_service_},
-        {"destination_canonical_revision", destination_canonical_revision_},
-        {"destination_cluster", destination_cluster_},
-        {"request_protocol", request_protocol_},
-        {"response_flags", response_flags_},
-        {"connection_security_policy", connection_security_policy_},
-        {"response_code", response_code_},
-        {"grpc_response_status", grpc_response_status_},
-    };
-  }
+SINGLETON_MANAGER_REGISTRATION(Context)
 
-  Stats::StatNamePool pool_;
-  const LocalInfo::LocalInfo& local_info_;
-  absl::flat_hash_map<std::string, Stats::StatName> all_metrics_;
-  absl::flat_hash_map<std::string, Stats::StatName> all_tags_;
-
-  // Metric names.
-  const Stats::StatName stat_namespace_;
-  const Stats::StatName requests_total_;
-  const Stats::StatName request_duration_milliseconds_;
-  const Stats::StatName request_bytes_;
-  const Stats::StatName response_bytes_;
-  const Stats::StatName request_messages_total_;
-  const Stats::StatName response_messages_total_;
-  const Stats::StatName tcp_connections_opened_total_;
-  const Stats::StatName tcp_connections_closed_total_;
-  const Stats::StatName tcp_sent_bytes_total_;
-  const Stats::StatName tcp_received_bytes_total_;
-
-  // Constant names.
-  const Stats::StatName empty_;
-  const Stats::StatName unknown_;
-  const Stats::StatName source_;
-  const Stats::StatName destination_;
-  const Stats::StatName latest_;
-  const Stats::StatName http_;
-  const Stats::StatName grpc_;
-  const Stats::StatName tcp_;
-  const Stats::StatName mutual_tls_;
-  const Stats::StatName none_;
-
-  // Tag names.
-  const Stats::StatName reporter_;
-
-  const Stats::StatName source_workload_;
-  const Stats::StatName source_workload_namespace_;
-  const Stats::StatName source_principal_;
-  const Stats::StatName source_app_;
-  const Stats::StatName source_version_;
-  const Stats::StatName source_canonical_service_;
-  const Stats::StatName source_canonical_revision_;
-  const Stats::StatName source_cluster_;
-
-  const Stats::StatName destination_workload_;
-  const Stats::StatName destination_workload_namespace_;
-  const Stats::StatName destination_principal_;
-  const Stats::StatName destination_app_;
-  const Stats::StatName destination_version_;
-  const Stats::StatName destination_service_;
-  const Stats::StatName destination_service_name_;
-  const Stats::StatName destination_service_namespace_;
-  const Stats::StatName destination_canonical_service_;
-  const Stats::StatName destination_canonical_revision_;
-  const Stats::StatName destination_cluster_;
-
-  const Stats::StatName request_protocol_;
-  const Stats::StatName response_flags_;
-  const Stats::StatName connection_security_policy_;
-  const Stats::StatName response_code_;
-  const Stats::StatName grpc_response_status_;
-
-  // Per-process constants.
-  const Stats::StatName workload_name_;
-  const Stats::StatName namespace_;
-  const Stats::StatName canonical_name_;
-  const Stats::StatName canonical_revision_;
-  const Stats::StatName app_name_;
-  const Stats::StatName app_version_;
-  const Stats::StatName cluster_name_;
-  const Stats::StatName waypoint_;
-
-  // istio_build metric:
-  // Publishes Istio version for the proxy as a gauge, sample data:
-  // testdata/metric/istio_build.yaml
-  // Sample value for istio_version: "1.17.0"
-  const Stats::StatName istio_build_;
-  const Stats::StatName component_;
-  const Stats::StatName proxy_;
-  const Stats::StatName tag_;
-  const Stats::StatName istio_version_;
-}; // namespace
+SINGLETON_MANAGER_REGISTRATION(ExpressionCache)
 
-using ContextSharedPtr = std::shared_ptr<Context>;
+// Request metrics handed off to the aggregator. The tag values are interned in the context
+// or held by the peer tag segment, so they outlive the stream.
+struct StatsRecord {
+  // Request protocol, response code, gRPC status, response flags and security policy.
+  static constexpr size_t StreamTags = 5;
 
-SINGLETON_MANAGER_REGISTRATION(Context)
+  Stats::StatNameTag reporter_{Stats::StatName(), Stats::StatName()};
+  PeerTagBlockSharedPtr peer_tags_;
+  std::array<Stats::StatNameTag, StreamTags> stream_tags_{};
+  absl::optional<uint64_t> duration_ms_;
+  absl::optional<std::pair<uint64_t, uint64_t>> bytes_;
+  bool record_histograms_{false};
+};
+
+#define ASYNC_RECORDING_STATS(COUNTER)                                                             \
+  COUNTER(overflow)                                                                                \
+  COUNTER(processed)
+
+struct AsyncRecordingStats {
+  ASYNC_RECORDING_STATS(GENERATE_COUNTER_STRUCT)
+};
+
+// The stats outlive the listener scope if a worker aggregator is released after the configuration.
+struct AsyncRecordingStatsHolder {
+  AsyncRecordingStatsHolder(Stats::Scope& scope)
+      : scope_(scope.getShared()),
+        stats_{ASYNC_RECORDING_STATS(
+            POOL_COUNTER_PREFIX(*scope_, "istio_stats.async_recording."))} {}
+  Stats::ScopeSharedPtr scope_;
+  AsyncRecordingStats stats_;
+};
 
-using google::api::expr::runtime::CelValue;
+using AsyncRecordingStatsSharedPtr = std::shared_ptr<AsyncRecordingStatsHolder>;
+
+// Per-worker batch of the standard request metrics. The filter pushes a compact record per
+// request, and the batch is recorded at the next iteration of the worker's event loop, so the tag
+// resolution and the stats updates are off the stream callbacks and the requests completed in the
+// same iteration share the warm caches. The records stay on the worker, a registered thread, so the
+// workers do not contend on a single recording thread. A record that does not fit in the batch is
+// rejected and counted, and the filter records it inline.
+class StatsAggregator : public ThreadLocal::ThreadLocalObject {
+public:
+  StatsAggregator(Event::Dispatcher& dispatcher, ContextSharedPtr context,
+                  RotatingScopeSharedPtr scope, uint32_t batch_size,
+                  AsyncRecordingStatsSharedPtr stats, std::unique_ptr<MetricCache> cache)
+      : context_(context), scope_(std::move(scope)), batch_size_(batch_size), stats_(stats),
+        cache_(std::move(cache)),
+        drain_callback_(dispatcher.createSchedulableCallback([this] { drain(); })) {
+    records_.reserve(batch_size_);
+  }
+  ~StatsAggregator() override { drain(); }
+
+  // Returns false if the batch is full, in which case the caller records the request metrics.
+  bool push(StatsRecord&& record) {
+    if (records_.size() >= batch_size_) {
+      stats_->stats_.overflow_.inc();
+      return false;
+    }
+    records_.push_back(std::move(record));
+    if (!drain_callback_->enabled()) {
+      drain_callback_->scheduleCallbackNextIteration();
+    }
+    return true;
+  }
+
+private:
+  void drain() {
+    if (records_.empty()) {
+      return;
+    }
+    cache_->refresh(*scope_);
+    for (const auto& record : records_) {
+      recordStats(record);
+    }
+    stats_->stats_.processed_.add(records_.size());
+    // Releases the peer tag segments.
+    records_.clear();
+  }
+
+  void recordStats(const StatsRecord& record) {
+    tags_.clear();
+    tags_.push_back(record.reporter_);
+    tags_.insert(tags_.end(), record.peer_tags_->tags_.begin(), record.peer_tags_->tags_.end());
+    tags_.insert(tags_.end(), record.stream_tags_.begin(), record.stream_tags_.end());
+    cache_->addCounter(cache_->counter(context_->requests_total_, tags_), 1);
+    if (!record.record_histograms_) {
+      return;
+    }
+    if (record.duration_ms_.has_value()) {
+      cache_
+          ->histogram(context_->request_duration_milliseconds_,
+                      Stats::Histogram::Unit::Milliseconds, tags_)
+          .recordValue(record.duration_ms_.value());
+    }
+    if (record.bytes_.has_value()) {
+      cache_->histogram(context_->request_bytes_, Stats::Histogram::Unit::Bytes, tags_)
+          .recordValue(record.bytes_->first);
+      cache_->histogram(context_->response_bytes_, Stats::Histogram::Unit::Bytes, tags_)
+          .recordValue(record.bytes_->second);
+    }
+  }
 
-// Instructions on dropping, creating, and overriding labels.
-// This is not the "hot path" of the metrics system and thus, fairly
-// unoptimized.
-struct MetricOverrides : public Logger::Loggable<Logger::Id::filter> {
-  MetricOverrides(ContextSharedPtr& context, Stats::SymbolTable& symbol_table)
-      : context_(context), pool_(symbol_table) {}
   ContextSharedPtr context_;
-  Stats::StatNameDynamicPool pool_;
+  // Shared with the configuration, so that the scope outlives the last drain.
+  RotatingScopeSharedPtr scope_;
+  const uint32_t batch_size_;
+  AsyncRecordingStatsSharedPtr stats_;
+  std::unique_ptr<MetricCache> cache_;
+  std::vector<StatsRecord> records_;
+  Stats::StatNameTagVector tags_;
+  Event::SchedulableCallbackPtr drain_callback_;
+};
+
+#define OTLP_EXPORT_STATS(COUNTER, HISTOGRAM)                                                      \
+  COUNTER(requests)                                                                                \
+  COUNTER(success)                                                                                 \
+  COUNTER(failure)                                                                                 \
+  COUNTER(data_points)                                                                             \
+  COUNTER(unchanged_series)                                                                        \
+  HISTOGRAM(duration_us, Microseconds)
+
+struct OtlpExportStats {
+  OTLP_EXPORT_STATS(GENERATE_COUNTER_STRUCT, GENERATE_HISTOGRAM_STRUCT)
+};
+
+using ExportMetricsServiceRequest =
+    opentelemetry::proto::collector::metrics::v1::ExportMetricsServiceRequest;
+using ExportMetricsServiceResponse =
+    opentelemetry::proto::collector::metrics::v1::ExportMetricsServiceResponse;
 
-  enum class MetricType {
-    Counter,
-    Gauge,
-    Histogram,
+// Exports the series changed since the previous export to an OTLP collector with the delta
+// temporality. The unchanged series are skipped, so the payload scales with the active series
+// instead of all the series. The exporter is shared by the configurations with the same export
+// settings and deduplicates the series shared by their scopes.
+//
+// The histogram deltas are computed from the cumulative statistics, which are updated by the stats
+// flush, so the export interval should not be shorter than the stats flush interval. The deltas of
+// a failed export are not retried.
+class OtlpExporter : public Logger::Loggable<Logger::Id::filter> {
+public:
+  OtlpExporter(const stats::OtlpExport& config,
+               Server::Configuration::ServerFactoryContext& server_context)
+      : time_source_(server_context.timeSource()), export_interval_(exportInterval(config)),
+        max_batch_size_(maxBatchSize(config)),
+        method_(*Protobuf::DescriptorPool::generated_pool()->FindMethodByName(
+            "opentelemetry.proto.collector.metrics.v1.MetricsService.Export")),
+        stats_{OTLP_EXPORT_STATS(
+            POOL_COUNTER_PREFIX(server_context.scope(), "istio_stats.otlp_export."),
+            POOL_HISTOGRAM_PREFIX(server_context.scope(), "istio_stats.otlp_export."))},
+        last_export_time_(time_source_.systemTime()) {
+    envoy::config::core::v3::GrpcService grpc_service;
+    grpc_service.mutable_envoy_grpc()->set_cluster_name(config.cluster());
+    auto client_or_error =
+        server_context.clusterManager().grpcAsyncClientManager().getOrCreateRawAsyncClient(
+            grpc_service, server_context.scope(), /* skip_cluster_check = */ true);
+    if (!client_or_error.ok()) {
+      throw EnvoyException(std::string(client_or_error.status().message()));
+    }
+    client_ = Grpc::AsyncClient<ExportMetricsServiceRequest, ExportMetricsServiceResponse>(
+        client_or_error.value());
+    timer_ = server_context.mainThreadDispatcher().createTimer([this] { onExport(); });
+    timer_->enableTimer(export_interval_);
+  }
+  ~OtlpExporter() {
+    for (auto& pending : pending_) {
+      pending->request_->cancel();
+    }
+  }
+
+  void addScope(RotatingScope& scope) { scopes_.insert(&scope); }
+  void removeScope(RotatingScope& scope) { scopes_.erase(&scope); }
+
+  static std::chrono::milliseconds exportInterval(const stats::OtlpExport& config) {
+    return std::chrono::milliseconds(
+        PROTOBUF_GET_MS_OR_DEFAULT(config, export_interval, /* 10s */ 10000));
+  }
+  static uint32_t maxBatchSize(const stats::OtlpExport& config) {
+    return config.max_batch_size() > 0 ? config.max_batch_size() : 1000;
+  }
+
+private:
+  struct SeriesState {
+    // Detects the reuse of the address by another series.
+    size_t name_hash_;
+    // Counter or gauge value, or histogram sample count.
+    uint64_t count_;
+    double sum_{0};
+    std::vector<uint64_t> buckets_;
   };
-  struct CustomMetric {
-    Stats::StatName name_;
-    uint32_t expr_;
-    MetricType type_;
-    explicit CustomMetric(Stats::StatName name, uint32_t expr, MetricType type)
-        : name_(name), expr_(expr), type_(type) {}
+  using SeriesMap = absl::flat_hash_map<const Stats::Metric*, SeriesState>;
+
+  struct PendingExport : public Grpc::AsyncRequestCallbacks<ExportMetricsServiceResponse>,
+                         public Logger::Loggable<Logger::Id::filter> {
+    explicit PendingExport(OtlpExporter& parent) : parent_(parent) {}
+
+    // Grpc::AsyncRequestCallbacks
+    void onCreateInitialMetadata(Http::RequestHeaderMap&) override {}
+    void onSuccess(Grpc::ResponsePtr<ExportMetricsServiceResponse>&&, Tracing::Span&) override {
+      parent_.stats_.success_.inc();
+      complete();
+    }
+    void onFailure(Grpc::Status::GrpcStatus status, const std::string& message,
+                   Tracing::Span&) override {
+      ENVOY_LOG(debug, "Istio stats OTLP export failed: {} {}", status, message);
+      parent_.stats_.failure_.inc();
+      complete();
+    }
+
+    // Inline failures are removed by the sender.
+    void complete() {
+      if (request_ != nullptr) {
+        parent_.pending_.erase(it_);
+      }
+    }
+
+    OtlpExporter& parent_;
+    Grpc::AsyncRequest* request_{nullptr};
+    std::list<std::unique_ptr<PendingExport>>::iterator it_;
   };
-  absl::flat_hash_map<std::string, CustomMetric> custom_metrics_;
-  // Initial transformation: metrics dropped.
-  absl::flat_hash_set<Stats::StatName> drop_;
-  // Second transformation: tags changed.
-  using TagOverrides = absl::flat_hash_map<Stats::StatName, absl::optional<uint32_t>>;
-  absl::flat_hash_map<Stats::StatName, TagOverrides> tag_overrides_;
-  // Third transformation: tags added.
-  using TagAdditions = std::vector<std::pair<Stats::StatName, uint32_t>>;
-  absl::flat_hash_map<Stats::StatName, TagAdditions> tag_additions_;
-
-  Stats::StatNameTagVector
-  overrideTags(Stats::StatName metric, const Stats::StatNameTagVector& tags,
-               const std::vector<std::pair<Stats::StatName, uint64_t>>& expr_values) {
-    Stats::StatNameTagVector out;
-    out.reserve(tags.size());
-    const auto& tag_overrides_it = tag_overrides_.find(metric);
-    if (tag_overrides_it == tag_overrides_.end()) {
-      out = tags;
-    } else
-      for (const auto& [key, val] : tags) {
-        const auto& it = tag_overrides_it->second.find(key);
-        if (it != tag_overrides_it->second.end()) {
-          if (it->second.has_value()) {
-            out.push_back({key, expr_values[it->second.value()].first});
-          } else {
-            // Skip dropped tags.
+
+  static uint64_t toNanos(SystemTime time) {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(time.time_since_epoch()).count();
+  }
+
+  void onExport() {
+    const MonotonicTime start = time_source_.monotonicTime();
+    const SystemTime now = time_source_.systemTime();
+    start_nanos_ = toNanos(last_export_time_);
+    now_nanos_ = toNanos(now);
+    SeriesMap series;
+    uint64_t unchanged = 0;
+    for (RotatingScope* rotating_scope : scopes_) {
+      rotating_scope->iterateScopes([&](Stats::Scope& scope) {
+        scope.iterate(Stats::IterateFn<Stats::Counter>([&](const Stats::CounterSharedPtr& counter) {
+          if (!exportCounter(*counter, series)) {
+            unchanged++;
           }
-        } else {
-          out.push_back({key, val});
-        }
-      }
-    const auto& tag_additions_it = tag_additions_.find(metric);
-    if (tag_additions_it != tag_additions_.end()) {
-      for (const auto& [tag, id] : tag_additions_it->second) {
-        out.push_back({tag, expr_values[id].first});
-      }
+          return true;
+        }));
+        scope.iterate(Stats::IterateFn<Stats::Gauge>([&](const Stats::GaugeSharedPtr& gauge) {
+          if (!exportGauge(*gauge, series)) {
+            unchanged++;
+          }
+          return true;
+        }));
+        scope.iterate(
+            Stats::IterateFn<Stats::Histogram>([&](const Stats::HistogramSharedPtr& histogram) {
+              if (!exportHistogram(*histogram, series)) {
+                unchanged++;
+              }
+              return true;
+            }));
+      });
     }
-    return out;
+    send();
+    series_ = std::move(series);
+    last_export_time_ = now;
+    stats_.unchanged_series_.add(unchanged);
+    stats_.duration_us_.recordValue(
+        std::chrono::duration_cast<std::chrono::microseconds>(time_source_.monotonicTime() -
+                                                              start)
+            .count());
+    timer_->enableTimer(export_interval_);
   }
-  absl::optional<uint32_t> getOrCreateExpression(const std::string& expr, bool int_expr) {
-    const auto& it = expression_ids_.find(expr);
-    if (it != expression_ids_.end()) {
-      return {it->second};
+
+  // Returns false if the series is unchanged or already visited through another scope.
+  bool exportCounter(const Stats::Counter& counter, SeriesMap& series) {
+    if (series.contains(&counter)) {
+      return true;
     }
-    auto parse_status = google::api::expr::parser::Parse(expr);
-    if (!parse_status.ok()) {
-      return {};
+    const size_t name_hash = counter.statName().hash();
+    const uint64_t value = counter.value();
+    const SeriesState* last = previous(counter, name_hash);
+    series.emplace(&counter, SeriesState{name_hash, value});
+    const uint64_t base = last != nullptr && last->count_ <= value ? last->count_ : 0;
+    if (value == base) {
+      return false;
     }
-    if (expr_builder_ == nullptr) {
-      google::api::expr::runtime::InterpreterOptions options;
-      expr_builder_ = google::api::expr::runtime::CreateCelExpressionBuilder(options);
-      auto register_status = google::api::expr::runtime::RegisterBuiltinFunctions(
-          expr_builder_->GetRegistry(), options);
-      if (!register_status.ok()) {
-        throw Extensions::Filters::Common::Expr::CelException(
-            absl::StrCat("failed to register built-in functions: ", register_status.message()));
-      }
+    auto* sum = metric(counter).mutable_sum();
+    sum->set_aggregation_temporality(
+        opentelemetry::proto::metrics::v1::AGGREGATION_TEMPORALITY_DELTA);
+    sum->set_is_monotonic(true);
+    auto* point = sum->add_data_points();
+    point->set_start_time_unix_nano(start_nanos_);
+    point->set_time_unix_nano(now_nanos_);
+    setAttributes(*point, counter);
+    point->set_as_int(value - base);
+    pointAdded();
+    return true;
+  }
+
+  bool exportGauge(const Stats::Gauge& gauge, SeriesMap& series) {
+    if (series.contains(&gauge)) {
+      return true;
+    }
+    const size_t name_hash = gauge.statName().hash();
+    const uint64_t value = gauge.value();
+    const SeriesState* last = previous(gauge, name_hash);
+    series.emplace(&gauge, SeriesState{name_hash, value});
+    if (last != nullptr && last->count_ == value) {
+      return false;
+    }
+    auto* point = metric(gauge).mutable_gauge()->add_data_points();
+    point->set_time_unix_nano(now_nanos_);
+    setAttributes(*point, gauge);
+    point->set_as_int(value);
+    pointAdded();
+    return true;
+  }
+
+  bool exportHistogram(const Stats::Histogram& histogram, SeriesMap& series) {
+    if (series.contains(&histogram)) {
+      return true;
+    }
+    const auto* parent = dynamic_cast<const Stats::ParentHistogram*>(&histogram);
+    if (parent == nullptr) {
+      return false;
+    }
+    const Stats::HistogramStatistics& statistics = parent->cumulativeStatistics();
+    const size_t name_hash = histogram.statName().hash();
+    const SeriesState* last = previous(histogram, name_hash);
+    SeriesState& state =
+        series.emplace(&histogram, SeriesState{name_hash, statistics.sampleCount()}).first->second;
+    state.sum_ = statistics.sampleSum();
+    state.buckets_ = statistics.computedBuckets();
+    if (last != nullptr && last->count_ == state.count_) {
+      return false;
+    }
+    // The cumulative statistics restart if the histogram is re-created.
+    const bool delta = last != nullptr && last->count_ < state.count_ &&
+                       last->buckets_.size() == state.buckets_.size();
+    auto* otlp_histogram = metric(histogram).mutable_histogram();
+    otlp_histogram->set_aggregation_temporality(
+        opentelemetry::proto::metrics::v1::AGGREGATION_TEMPORALITY_DELTA);
+    auto* point = otlp_histogram->add_data_points();
+    point->set_start_time_unix_nano(start_nanos_);
+    point->set_time_unix_nano(now_nanos_);
+    setAttributes(*point, histogram);
+    const uint64_t count = state.count_ - (delta ? last->count_ : 0);
+    point->set_count(count);
+    point->set_sum(state.sum_ - (delta ? last->sum_ : 0));
+    // The computed buckets are cumulative, the OTLP buckets are disjoint with an overflow bucket.
+    uint64_t previous_cumulative = 0;
+    for (size_t i = 0; i < state.buckets_.size(); i++) {
+      const uint64_t cumulative = state.buckets_[i] - (delta ? last->buckets_[i] : 0);
+      point->add_explicit_bounds(statistics.supportedBuckets()[i]);
+      point->add_bucket_counts(cumulative - previous_cumulative);
+      previous_cumulative = cumulative;
+    }
+    point->add_bucket_counts(count - previous_cumulative);
+    pointAdded();
+    return true;
+  }
+
+  const SeriesState* previous(const Stats::Metric& metric, size_t name_hash) const {
+    const auto it = series_.find(&metric);
+    return it != series_.end() && it->second.name_hash_ == name_hash ? &it->second : nullptr;
+  }
+
+  template <class Point> static void setAttributes(Point& point, const Stats::Metric& metric) {
+    for (const auto& tag : metric.tags()) {
+      auto* attribute = point.add_attributes();
+      attribute->set_key(tag.name_);
+      attribute->mutable_value()->set_string_value(tag.value_);
+    }
+  }
+
+  // Returns the metric of the series in the current request, grouping the series by name.
+  opentelemetry::proto::metrics::v1::Metric& metric(const Stats::Metric& series) {
+    if (request_ == nullptr) {
+      request_ = std::make_unique<ExportMetricsServiceRequest>();
+      scope_metrics_ = request_->add_resource_metrics()->add_scope_metrics();
+      scope_metrics_->mutable_scope()->set_name("istio_stats");
+    }
+    const std::string name = series.tagExtractedName();
+    auto it = metrics_.find(name);
+    if (it == metrics_.end()) {
+      auto* metric = scope_metrics_->add_metrics();
+      metric->set_name(
+          std::string(absl::StripPrefix(name, absl::StrCat(CustomStatNamespace, "."))));
+      it = metrics_.emplace(name, metric).first;
+    }
+    return *it->second;
+  }
+
+  void pointAdded() {
+    if (++points_ >= max_batch_size_) {
+      send();
     }
-    parsed_exprs_.push_back(parse_status.value().expr());
-    compiled_exprs_.push_back(std::make_pair(
-        Extensions::Filters::Common::Expr::createExpression(*expr_builder_, parsed_exprs_.back()),
-        int_expr));
-    uint32_t id = compiled_exprs_.size() - 1;
-    expression_ids_.emplace(expr, id);
-    return {id};
-  }
-  Filters::Common::Expr::BuilderPtr expr_builder_;
-  std::vector<google::api::expr::v1alpha1::Expr> parsed_exprs_;
-  std::vector<std::pair<Filters::Common::Expr::ExpressionPtr, bool>> compiled_exprs_;
-  absl::flat_hash_map<std::string, uint32_t> expression_ids_;
+  }
+
+  void send() {
+    if (request_ == nullptr) {
+      return;
+    }
+    stats_.requests_.inc();
+    stats_.data_points_.add(points_);
+    pending_.push_front(std::make_unique<PendingExport>(*this));
+    PendingExport& pending = *pending_.front();
+    pending.it_ = pending_.begin();
+    pending.request_ = client_.send(method_, *request_, pending, Tracing::NullSpan::instance(),
+                                    Http::AsyncClient::RequestOptions());
+    if (pending.request_ == nullptr) {
+      pending_.erase(pending.it_);
+    }
+    request_.reset();
+    scope_metrics_ = nullptr;
+    metrics_.clear();
+    points_ = 0;
+  }
+
+  TimeSource& time_source_;
+  const std::chrono::milliseconds export_interval_;
+  const uint32_t max_batch_size_;
+  const Protobuf::MethodDescriptor& method_;
+  OtlpExportStats stats_;
+  Grpc::AsyncClient<ExportMetricsServiceRequest, ExportMetricsServiceResponse> client_;
+  Event::TimerPtr timer_;
+  absl::flat_hash_set<RotatingScope*> scopes_;
+  // Series of the previous export. The keys are only compared.
+  SeriesMap series_;
+  SystemTime last_export_time_;
+  std::list<std::unique_ptr<PendingExport>> pending_;
+
+  // Request being built.
+  uint64_t start_nanos_{0};
+  uint64_t now_nanos_{0};
+  std::unique_ptr<ExportMetricsServiceRequest> request_;
+  opentelemetry::proto::metrics::v1::ScopeMetrics* scope_metrics_{nullptr};
+  absl::flat_hash_map<std::string, opentelemetry::proto::metrics::v1::Metric*> metrics_;
+  uint32_t points_{0};
 };
 
-// Self-managed scope with active rotation. Envoy stats scope controls the
-// lifetime of the individual metrics. Because the scope is attached to xDS
-// resources, metrics with data derived from the requests can accumulate and
-// grow indefinitely for long-living xDS resources. To limit this growth,
-// this class implements a rotation mechanism, whereas a new scope is created
-// periodically to replace the current scope.
-//
-// The replaced stats scope is deleted gracefully after a minimum of 1s delay
-// for two reasons:
-//
-// 1. Stats flushing is asynchronous and the data may be lost if not flushed
-// before the deletion (see stats_flush_interval).
-//
-// 2. The implementation avoids locking by releasing a raw pointer to workers.
-// When the rotation happens on the main, the raw pointer may still be in-use
-// by workers for a short duration.
-class RotatingScope : public Logger::Loggable<Logger::Id::filter> {
+using OtlpExporterSharedPtr = std::shared_ptr<OtlpExporter>;
+
+// Exporters by the collector cluster. Only accessed on the main thread.
+// Registry of the exporters by the export settings, so that the configurations exporting to the
+// same collector with different intervals or batch sizes do not share an exporter.
+class OtlpExporterRegistry : public Singleton::Instance {
+public:
+  OtlpExporterSharedPtr getOrCreate(const stats::OtlpExport& config,
+                                    Server::Configuration::ServerFactoryContext& server_context) {
+    auto& exporter =
+        exporters_[{config.cluster(), OtlpExporter::exportInterval(config).count(),
+                    OtlpExporter::maxBatchSize(config)}];
+    OtlpExporterSharedPtr shared = exporter.lock();
+    if (!shared) {
+      shared = std::make_shared<OtlpExporter>(config, server_context);
+      exporter = shared;
+    }
+    return shared;
+  }
+
+private:
+  // Keyed by the cluster, the export interval in milliseconds and the maximum batch size.
+  absl::flat_hash_map<std::tuple<std::string, int64_t, uint32_t>, std::weak_ptr<OtlpExporter>>
+      exporters_;
+};
+
+SINGLETON_MANAGER_REGISTRATION(OtlpExporterRegistry)
+
+// Path templates compiled into a trie of path segments. The templates are identified by the index
+// of their rule, and a path is matched against all the templates in a single walk.
+class PathTemplateTrie {
 public:
-  RotatingScope(Server::Configuration::FactoryContext& factory_context, uint64_t rotate_interval_ms,
-                uint64_t delete_interval_ms)
-      : parent_scope_(factory_context.scope()), active_scope_(parent_scope_.createScope("")),
-        raw_scope_(active_scope_.get()), rotate_interval_ms_(rotate_interval_ms),
-        delete_interval_ms_(delete_interval_ms) {
-    if (rotate_interval_ms_ > 0) {
-      ASSERT(delete_interval_ms_ < rotate_interval_ms_);
-      ASSERT(delete_interval_ms_ >= 1000);
-      Event::Dispatcher& dispatcher = factory_context.serverFactoryContext().mainThreadDispatcher();
-      rotate_timer_ = dispatcher.createTimer([this] { onRotate(); });
-      delete_timer_ = dispatcher.createTimer([this] { onDelete(); });
-      rotate_timer_->enableTimer(std::chrono::milliseconds(rotate_interval_ms_));
+  using Matches = absl::InlinedVector<uint32_t, 8>;
+
+  // Returns false if a "**" segment is not the last segment of the template.
+  static bool validTemplate(absl::string_view path_template) {
+    const std::vector<absl::string_view> segments = splitPath(path_template);
+    for (size_t i = 0; i + 1 < segments.size(); i++) {
+      if (segments[i] == "**") {
+        return false;
+      }
     }
+    return true;
   }
-  ~RotatingScope() {
-    if (rotate_timer_) {
-      rotate_timer_->disableTimer();
-      rotate_timer_.reset();
+
+  // The template must be valid.
+  void add(absl::string_view path_template, uint32_t rule) {
+    ASSERT(validTemplate(path_template));
+    Node* node = &root_;
+    const std::vector<absl::string_view> segments = splitPath(path_template);
+    for (size_t i = 0; i < segments.size(); i++) {
+      if (segments[i] == "**") {
+        node->remaining_rules_.push_back(rule);
+        return;
+      }
+      std::unique_ptr<Node>& child =
+          segments[i] == "*" ? node->wildcard_ : node->children_[std::string(segments[i])];
+      if (child == nullptr) {
+        child = std::make_unique<Node>();
+      }
+      node = child.get();
     }
-    if (delete_timer_) {
-      delete_timer_->disableTimer();
-      delete_timer_.reset();
+    node->rules_.push_back(rule);
+  }
+
+  // Appends the rules with a template matching the path, in no particular order.
+  void match(absl::string_view path, Matches& matches) const {
+    path = path.substr(0, path.find('?'));
+    // The nodes reached by the segments so far.
+    absl::InlinedVector<const Node*, 8> nodes{&root_};
+    absl::InlinedVector<const Node*, 8> next;
+    for (absl::string_view segment : absl::StrSplit(trimPath(path), '/')) {
+      next.clear();
+      for (const Node* node : nodes) {
+        matches.insert(matches.end(), node->remaining_rules_.begin(),
+                       node->remaining_rules_.end());
+        const auto it = node->children_.find(segment);
+        if (it != node->children_.end()) {
+          next.push_back(it->second.get());
+        }
+        if (node->wildcard_ != nullptr) {
+          next.push_back(node->wildcard_.get());
+        }
+      }
+      nodes.swap(next);
+      if (nodes.empty()) {
+        return;
+      }
+    }
+    for (const Node* node : nodes) {
+      matches.insert(matches.end(), node->rules_.begin(), node->rules_.end());
+      matches.insert(matches.end(), node->remaining_rules_.begin(), node->remaining_rules_.end());
+    }
+  }
+
+private:
+  struct Node {
+    absl::flat_hash_map<std::string, std::unique_ptr<Node>> children_;
+    std::unique_ptr<Node> wildcard_;
+    // Rules with a template ending at this node.
+    std::vector<uint32_t> rules_;
+    // Rules with a template ending with "**" after this node.
+    std::vector<uint32_t> remaining_rules_;
+  };
+
+  static absl::string_view trimPath(absl::string_view path) {
+    return absl::StripPrefix(path, "/");
+  }
+  static std::vector<absl::string_view> splitPath(absl::string_view path) {
+    return absl::StrSplit(trimPath(path), '/');
+  }
+
+  Node root_;
+};
+
+// Native replacement of the tag values generated by the attributegen Wasm filter. The rules are
+// compiled at configuration time, and the values are interned, so that the classification does
+// not evaluate expressions. The rules must be valid (see validateRequestClassifiers).
+class RequestClassifier {
+public:
+  RequestClassifier(const stats::RequestClassifier& proto_config, Stats::StatName tag,
+                    bool standard, Stats::StatNamePool& pool)
+      : tag_(tag), standard_(standard) {
+    for (const auto& rule : proto_config.rules()) {
+      // A bound of 0 leaves the range open on that side.
+      const uint32_t response_code_max = rule.response_code_max() > 0
+                                             ? rule.response_code_max()
+                                             : std::numeric_limits<uint32_t>::max();
+      const uint32_t index = rules_.size();
+      rules_.push_back({pool.add(rule.value()),
+                        {rule.methods().begin(), rule.methods().end()},
+                        rule.paths().empty(),
+                        rule.response_code_min(),
+                        response_code_max});
+      for (const auto& path : rule.paths()) {
+        paths_.add(path, index);
+      }
+    }
+  }
+
+  // Returns the value of the first matching rule, or an empty name if none matches.
+  Stats::StatName classify(absl::string_view method, absl::string_view path,
+                           uint64_t response_code) const {
+    PathTemplateTrie::Matches path_matches;
+    paths_.match(path, path_matches);
+    for (uint32_t i = 0; i < rules_.size(); i++) {
+      const Rule& rule = rules_[i];
+      if (!rule.any_path_ &&
+          std::find(path_matches.begin(), path_matches.end(), i) == path_matches.end()) {
+        continue;
+      }
+      if (!rule.methods_.empty() &&
+          std::find(rule.methods_.begin(), rule.methods_.end(), method) == rule.methods_.end()) {
+        continue;
+      }
+      if (response_code < rule.response_code_min_ || response_code > rule.response_code_max_) {
+        continue;
+      }
+      return rule.value_;
     }
+    return {};
   }
-  Stats::Scope* scope() { return raw_scope_.load(); }
+
+  const Stats::StatName tag_;
+  // Standard tags are overwritten, the other tags are added.
+  const bool standard_;
 
 private:
-  void onRotate() {
-    ENVOY_LOG(info, "Rotating active Istio stats scope after {}ms.", rotate_interval_ms_);
-    draining_scope_ = active_scope_;
-    delete_timer_->enableTimer(std::chrono::milliseconds(delete_interval_ms_));
-    active_scope_ = parent_scope_.createScope("");
-    raw_scope_.store(active_scope_.get());
-    rotate_timer_->enableTimer(std::chrono::milliseconds(rotate_interval_ms_));
-  }
-  void onDelete() {
-    ENVOY_LOG(info, "Deleting draining Istio stats scope after {}ms.", delete_interval_ms_);
-    draining_scope_.reset();
-  }
-  Stats::Scope& parent_scope_;
-  Stats::ScopeSharedPtr active_scope_;
-  std::atomic<Stats::Scope*> raw_scope_;
-  Stats::ScopeSharedPtr draining_scope_{nullptr};
-  const uint64_t rotate_interval_ms_;
-  const uint64_t delete_interval_ms_;
-  Event::TimerPtr rotate_timer_{nullptr};
-  Event::TimerPtr delete_timer_{nullptr};
+  struct Rule {
+    Stats::StatName value_;
+    std::vector<std::string> methods_;
+    bool any_path_;
+    uint32_t response_code_min_;
+    uint32_t response_code_max_;
+  };
+
+  std::vector<Rule> rules_;
+  PathTemplateTrie paths_;
 };
 
+// Rejects the malformed classification rules before the configuration is created.
+absl::Status validateRequestClassifiers(const stats::PluginConfig& proto_config) {
+  for (const auto& classifier : proto_config.request_classifiers()) {
+    for (const auto& rule : classifier.rules()) {
+      if (rule.response_code_max() > 0 && rule.response_code_min() > rule.response_code_max()) {
+        return absl::InvalidArgumentError(
+            absl::StrCat("invalid response code range of the classification rule ", rule.value(),
+                         ": ", rule.response_code_min(), " > ", rule.response_code_max()));
+      }
+      for (const auto& path : rule.paths()) {
+        if (!PathTemplateTrie::validTemplate(path)) {
+          return absl::InvalidArgumentError(
+              absl::StrCat("invalid path template of the classification rule ", rule.value(),
+                           ": \"**\" is not the last segment of ", path));
+        }
+      }
+    }
+  }
+  return absl::OkStatus();
+}
+
+absl::optional<std::chrono::nanoseconds> elapsedBetween(absl::optional<MonotonicTime> start,
+                                                        absl::optional<MonotonicTime> end) {
+  if (!start.has_value() || !end.has_value() || end.value() < start.value()) {
+    return absl::nullopt;
+  }
+  return end.value() - start.value();
+}
+
+// Returns the duration of the latency phase, if the stream has both its timings.
+absl::optional<std::chrono::nanoseconds> latencyPhaseDuration(stats::LatencyPhase phase,
+                                                              const StreamInfo::StreamInfo& info) {
+  if (phase == stats::LatencyPhase::DOWNSTREAM_REQUEST) {
+    const auto downstream_timing = info.downstreamTiming();
+    return downstream_timing ? elapsedBetween(info.startTimeMonotonic(),
+                                              downstream_timing->lastDownstreamRxByteReceived())
+                             : absl::nullopt;
+  }
+  const auto upstream_info = info.upstreamInfo();
+  if (!upstream_info) {
+    return absl::nullopt;
+  }
+  const StreamInfo::UpstreamTiming& timing = upstream_info->upstreamTiming();
+  switch (phase) {
+  case stats::LatencyPhase::UPSTREAM_CONNECTION:
+    return timing.connectionPoolCallbackLatency();
+  case stats::LatencyPhase::UPSTREAM_REQUEST:
+    return elapsedBetween(timing.first_upstream_tx_byte_sent_,
+                          timing.last_upstream_tx_byte_sent_);
+  case stats::LatencyPhase::UPSTREAM_SERVICE:
+    return elapsedBetween(timing.last_upstream_tx_byte_sent_,
+                          timing.first_upstream_rx_byte_received_);
+  case stats::LatencyPhase::UPSTREAM_RESPONSE:
+    return elapsedBetween(timing.first_upstream_rx_byte_received_,
+                          timing.last_upstream_rx_byte_received_);
+  case stats::LatencyPhase::DOWNSTREAM_RESPONSE: {
+    const auto downstream_timing = info.downstreamTiming();
+    return downstream_timing ? elapsedBetween(timing.last_upstream_rx_byte_received_,
+                                              downstream_timing->lastDownstreamTxByteSent())
+                             : absl::nullopt;
+  }
+  default:
+    return absl::nullopt;
+  }
+}
+
+Reporter resolveReporter(const stats::PluginConfig& proto_config,
+                         Server::Configuration::FactoryContext& factory_context) {
+  switch (proto_config.reporter()) {
+  case stats::Reporter::UNSPECIFIED:
+    switch (factory_context.listenerInfo().direction()) {
+    case envoy::config::core::v3::TrafficDirection::INBOUND:
+      return Reporter::ServerSidecar;
+    case envoy::config::core::v3::TrafficDirection::OUTBOUND:
+      return Reporter::ClientSidecar;
+    default:
+      break;
+    }
+    break;
+  case stats::Reporter::SERVER_GATEWAY:
+    return Reporter::ServerGateway;
+  default:
+    break;
+  }
+  return Reporter::ClientSidecar;
+}
+
+// The configuration only depends on the filter configuration and the reporter, so that it is
+// shared by the listeners and the filter chains (see ConfigRegistry). The stats live in the server
+// scope for the same reason.
 struct Config : public Logger::Loggable<Logger::Id::filter> {
-  Config(const stats::PluginConfig& proto_config,
-         Server::Configuration::FactoryContext& factory_context)
-      : context_(factory_context.serverFactoryContext().singletonManager().getTyped<Context>(
+  Config(const stats::PluginConfig& proto_config, Reporter reporter,
+         Server::Configuration::ServerFactoryContext& server_context)
+      : context_(server_context.singletonManager().getTyped<Context>(
             SINGLETON_MANAGER_REGISTERED_NAME(Context),
-            [&factory_context] {
-              return std::make_shared<Context>(
-                  factory_context.serverFactoryContext().scope().symbolTable(),
-                  factory_context.serverFactoryContext().localInfo());
+            [&server_context] {
+              return std::make_shared<Context>(server_context.scope().symbolTable(),
+                                               server_context.localInfo());
             })),
-        scope_(factory_context, PROTOBUF_GET_MS_OR_DEFAULT(proto_config, rotation_interval, 0),
-               PROTOBUF_GET_MS_OR_DEFAULT(proto_config, graceful_deletion_interval,
-                                          /* 5m */ 1000 * 60 * 5)),
+        scope_(std::make_shared<RotatingScope>(
+            server_context, PROTOBUF_GET_MS_OR_DEFAULT(proto_config, rotation_interval, 0),
+            PROTOBUF_GET_MS_OR_DEFAULT(proto_config, graceful_deletion_interval,
+                                       /* 5m */ 1000 * 60 * 5),
+            proto_config.idle_series_eviction_intervals())),
+        reporter_(reporter),
         disable_host_header_fallback_(proto_config.disable_host_header_fallback()),
         report_duration_(
-            PROTOBUF_GET_MS_OR_DEFAULT(proto_config, tcp_reporting_duration, /* 5s */ 5000)) {
-    recordVersion(factory_context);
-    reporter_ = Reporter::ClientSidecar;
-    switch (proto_config.reporter()) {
-    case stats::Reporter::UNSPECIFIED:
-      switch (factory_context.listenerInfo().direction()) {
-      case envoy::config::core::v3::TrafficDirection::INBOUND:
-        reporter_ = Reporter::ServerSidecar;
-        break;
-      case envoy::config::core::v3::TrafficDirection::OUTBOUND:
-        reporter_ = Reporter::ClientSidecar;
-        break;
-      default:
-        break;
+            PROTOBUF_GET_MS_OR_DEFAULT(proto_config, tcp_reporting_duration, /* 5s */ 5000)),
+        histogram_sample_rate_(std::max<uint32_t>(proto_config.histogram_sample_rate(), 1)),
+        classification_pool_(server_context.scope().symbolTable()),
+        metric_cache_(
+            ThreadLocal::TypedSlot<MetricCache>::makeUnique(server_context.threadLocal())),
+        report_wheel_(
+            ThreadLocal::TypedSlot<ReportWheel>::makeUnique(server_context.threadLocal())) {
+    report_wheel_->set([report_duration = report_duration_](Event::Dispatcher& dispatcher) {
+      return std::make_shared<ReportWheel>(dispatcher, report_duration);
+    });
+    const std::chrono::milliseconds counter_flush_interval(
+        PROTOBUF_GET_MS_OR_DEFAULT(proto_config, counter_flush_interval, 0));
+    auto tag_value_stats = std::make_shared<TagValueCacheStatsHolder>(server_context.scope());
+    CardinalityLimiterSharedPtr limiter;
+    if (proto_config.cardinality_limits_size() > 0) {
+      limiter =
+          std::make_shared<CardinalityLimiter>(proto_config, server_context.scope(), context_);
+      scope_->setKeptSeriesCallback([limiter](Stats::Scope& scope, uint64_t generation) {
+        limiter->seed(generation, scope);
+      });
+    }
+    if (proto_config.self_telemetry()) {
+      self_telemetry_ =
+          std::make_shared<SelfTelemetry>(server_context, MessageUtil::hash(proto_config));
+    }
+    if (proto_config.async_recording_ring_size() > 0) {
+      auto async_recording_stats =
+          std::make_shared<AsyncRecordingStatsHolder>(server_context.scope());
+      aggregator_ =
+          ThreadLocal::TypedSlot<StatsAggregator>::makeUnique(server_context.threadLocal());
+      aggregator_->set([context = context_, scope = scope_,
+                        batch_size = proto_config.async_recording_ring_size(),
+                        counter_flush_interval, &server_scope = server_context.scope(),
+                        tag_value_stats, limiter, self_telemetry = self_telemetry_,
+                        async_recording_stats](Event::Dispatcher& dispatcher) {
+        return std::make_shared<StatsAggregator>(
+            dispatcher, context, scope, batch_size, async_recording_stats,
+            std::make_unique<MetricCache>(dispatcher, context, counter_flush_interval,
+                                          server_scope, tag_value_stats, limiter,
+                                          self_telemetry));
+      });
+    }
+    metric_cache_->set([context = context_, counter_flush_interval,
+                        &server_scope = server_context.scope(), tag_value_stats, limiter,
+                        self_telemetry = self_telemetry_](Event::Dispatcher& dispatcher) {
+      return std::make_shared<MetricCache>(dispatcher, context, counter_flush_interval,
+                                           server_scope, tag_value_stats, limiter, self_telemetry);
+    });
+    recordVersion(server_context.scope());
+    if (histogram_sample_rate_ > 1) {
+      const Stats::StatName reporter_value =
+          reporter_ == Reporter::ClientSidecar   ? context_->source_
+          : reporter_ == Reporter::ServerGateway ? context_->waypoint_
+                                                 : context_->destination_;
+      Stats::Utility::gaugeFromStatNames(server_context.scope(), {context_->histogram_sample_rate_},
+                                         Stats::Gauge::ImportMode::NeverImport,
+                                         {{context_->reporter_, reporter_value}})
+          .set(histogram_sample_rate_);
+    }
+    for (const auto phase : proto_config.latency_phases()) {
+      const Stats::StatName metric = latencyPhaseMetric(static_cast<stats::LatencyPhase>(phase));
+      if (metric.empty()) {
+        ENVOY_LOG(info, "Unknown latency phase ignored: {}", phase);
+        continue;
+      }
+      const LatencyPhase entry{static_cast<stats::LatencyPhase>(phase), metric};
+      if (std::find(latency_phases_.begin(), latency_phases_.end(), entry) ==
+          latency_phases_.end()) {
+        latency_phases_.push_back(entry);
       }
-      break;
-    case stats::Reporter::SERVER_GATEWAY:
-      reporter_ = Reporter::ServerGateway;
-      break;
-    default:
-      break;
+    }
+    for (const auto& classifier : proto_config.request_classifiers()) {
+      if (classifier.tag().empty()) {
+        ENVOY_LOG(info, "Request classifier without a tag ignored.");
+        continue;
+      }
+      const auto& tag_it = context_->all_tags_.find(classifier.tag());
+      const bool standard = tag_it != context_->all_tags_.end();
+      classifiers_.emplace_back(
+          classifier, standard ? tag_it->second : classification_pool_.add(classifier.tag()),
+          standard, classification_pool_);
     }
     if (proto_config.metrics_size() > 0 || proto_config.definitions_size() > 0) {
-      metric_overrides_ = std::make_unique<MetricOverrides>(context_, scope()->symbolTable());
+      metric_overrides_ = std::make_unique<MetricOverrides>(
+          context_, scope()->symbolTable(),
+          server_context.singletonManager().getTyped<ExpressionCache>(
+              SINGLETON_MANAGER_REGISTERED_NAME(ExpressionCache),
+              [&server_context] {
+                return std::make_shared<ExpressionCache>(server_context.scope());
+              },
+              /* pin = */ true));
       for (const auto& definition : proto_config.definitions()) {
         const auto& it = context_->all_metrics_.find(definition.name());
         if (it != context_->all_metrics_.end()) {
@@ -625,109 +1054,126 @@ struct Config : public Logger::Loggable<Logger::Id::filter> {
           }
         }
       }
+      std::vector<Stats::StatName> latency_phase_metrics;
+      for (const auto& phase : latency_phases_) {
+        latency_phase_metrics.push_back(phase.metric_);
+      }
+      metric_overrides_->computePhaseExpressions(*context_, latency_phase_metrics);
+      if (self_telemetry_) {
+        self_telemetry_->setExpressionCount(metric_overrides_->compiled_exprs_.size());
+      }
+    }
+    // Registered last, since the destructor does not run if the constructor throws.
+    if (proto_config.has_otlp_export()) {
+      otlp_exporter_ =
+          server_context.singletonManager()
+              .getTyped<OtlpExporterRegistry>(
+                  SINGLETON_MANAGER_REGISTERED_NAME(OtlpExporterRegistry),
+                  [] { return std::make_shared<OtlpExporterRegistry>(); }, /* pin = */ true)
+              ->getOrCreate(proto_config.otlp_export(), server_context);
+      otlp_exporter_->addScope(*scope_);
+    }
+  }
+  ~Config() {
+    if (otlp_exporter_) {
+      otlp_exporter_->removeScope(*scope_);
     }
   }
 
   // RAII for stream context propagation.
   struct StreamOverrides : public Filters::Common::Expr::StreamActivation {
-    StreamOverrides(Config& parent, Stats::StatNameDynamicPool& pool)
+    StreamOverrides(Config& parent, TagValuePool& pool)
         : parent_(parent), pool_(pool) {}
 
-    void evaluate(const StreamInfo::StreamInfo& info,
+    // Evaluates the expressions that the metrics recorded in the phase depend on. Values of the
+    // other expressions are kept from the previous evaluations.
+    void evaluate(MetricOverrides::Phase phase, const StreamInfo::StreamInfo& info,
                   const Http::RequestHeaderMap* request_headers = nullptr,
                   const Http::ResponseHeaderMap* response_headers = nullptr,
                   const Http::ResponseTrailerMap* response_trailers = nullptr) {
       evaluated_ = true;
       if (parent_.metric_overrides_) {
+        // Sized before any early return, since the tag plans index the values by expression ID.
+        const auto& compiled_exprs = parent_.metric_overrides_->compiled_exprs_;
+        expr_values_.resize(compiled_exprs.size(), {parent_.context_->unknown_, 0});
+        const auto& expression_ids = parent_.metric_overrides_->phaseExpressions(phase);
+        if (expression_ids.empty()) {
+          return;
+        }
         local_info_ = &parent_.context_->local_info_;
         activation_info_ = &info;
         activation_request_headers_ = request_headers;
         activation_response_headers_ = response_headers;
         activation_response_trailers_ = response_trailers;
-        const auto& compiled_exprs = parent_.metric_overrides_->compiled_exprs_;
-        expr_values_.clear();
-        expr_values_.reserve(compiled_exprs.size());
-        for (size_t id = 0; id < compiled_exprs.size(); id++) {
-          Protobuf::Arena arena;
-          auto eval_status = compiled_exprs[id].first->Evaluate(*this, &arena);
+        Protobuf::Arena& arena = parent_.arena();
+        for (const uint32_t id : expression_ids) {
+          auto eval_status = compiled_exprs[id].first->expression_->Evaluate(*this, &arena);
           if (!eval_status.ok() || eval_status.value().IsError()) {
-            expr_values_.push_back(std::make_pair(parent_.context_->unknown_, 0));
-          } else {
-            const auto string_value = Filters::Common::Expr::print(eval_status.value());
-            if (compiled_exprs[id].second) {
-              uint64_t amount = 0;
-              if (!absl::SimpleAtoi(string_value, &amount)) {
-                ENVOY_LOG(trace, "Failed to get metric value: {}", string_value);
-              }
-              expr_values_.push_back(std::make_pair(Stats::StatName(), amount));
-            } else {
-              expr_values_.push_back(std::make_pair(pool_.add(string_value), 0));
+            expr_values_[id] = {parent_.context_->unknown_, 0};
+            if (parent_.self_telemetry_) {
+              parent_.self_telemetry_->expressionError(id);
             }
+          } else if (compiled_exprs[id].second) {
+            expr_values_[id] = {Stats::StatName(), celValueToAmount(eval_status.value())};
+          } else {
+            expr_values_[id] = {celValueToTag(eval_status.value(), pool_), 0};
           }
         }
+        // The values are consumed, release the arena allocations for the next evaluation.
+        arena.Reset();
         resetActivation();
       }
     }
 
+    const Stats::StatNameTagVector* overrideTags(Stats::StatName metric,
+                                                 const Stats::StatNameTagVector& tags) {
+      return parent_.metric_overrides_->overrideTags(metric, tags, expr_values_,
+                                                     parent_.tagPlans(), override_tags_);
+    }
+
     void addCounter(Stats::StatName metric, const Stats::StatNameTagVector& tags,
                     uint64_t amount = 1) {
       ASSERT(evaluated_);
       if (parent_.metric_overrides_) {
-        if (parent_.metric_overrides_->drop_.contains(metric)) {
-          return;
+        const auto* new_tags = overrideTags(metric, tags);
+        if (new_tags != nullptr) {
+          parent_.addCounter(metric, *new_tags, amount);
         }
-        auto new_tags = parent_.metric_overrides_->overrideTags(metric, tags, expr_values_);
-        Stats::Utility::counterFromStatNames(*parent_.scope(),
-                                             {parent_.context_->stat_namespace_, metric}, new_tags)
-            .add(amount);
         return;
       }
-      Stats::Utility::counterFromStatNames(*parent_.scope(),
-                                           {parent_.context_->stat_namespace_, metric}, tags)
-          .add(amount);
+      parent_.addCounter(metric, tags, amount);
     }
 
     void recordHistogram(Stats::StatName metric, Stats::Histogram::Unit unit,
                          const Stats::StatNameTagVector& tags, uint64_t value) {
       ASSERT(evaluated_);
       if (parent_.metric_overrides_) {
-        if (parent_.metric_overrides_->drop_.contains(metric)) {
-          return;
+        const auto* new_tags = overrideTags(metric, tags);
+        if (new_tags != nullptr) {
+          parent_.histogram(metric, unit, *new_tags).recordValue(value);
         }
-        auto new_tags = parent_.metric_overrides_->overrideTags(metric, tags, expr_values_);
-        Stats::Utility::histogramFromStatNames(
-            *parent_.scope(), {parent_.context_->stat_namespace_, metric}, unit, new_tags)
-            .recordValue(value);
         return;
       }
-      Stats::Utility::histogramFromStatNames(
-          *parent_.scope(), {parent_.context_->stat_namespace_, metric}, unit, tags)
-          .recordValue(value);
+      parent_.histogram(metric, unit, tags).recordValue(value);
     }
 
     void recordCustomMetrics() {
       ASSERT(evaluated_);
       if (parent_.metric_overrides_) {
         for (const auto& [_, metric] : parent_.metric_overrides_->custom_metrics_) {
-          const auto tags = parent_.metric_overrides_->overrideTags(metric.name_, {}, expr_values_);
+          // Custom metrics are never dropped.
+          const auto& tags = *overrideTags(metric.name_, {});
           uint64_t amount = expr_values_[metric.expr_].second;
           switch (metric.type_) {
           case MetricOverrides::MetricType::Counter:
-            Stats::Utility::counterFromStatNames(
-                *parent_.scope(), {parent_.context_->stat_namespace_, metric.name_}, tags)
-                .add(amount);
+            parent_.addCounter(metric.name_, tags, amount);
             break;
           case MetricOverrides::MetricType::Histogram:
-            Stats::Utility::histogramFromStatNames(
-                *parent_.scope(), {parent_.context_->stat_namespace_, metric.name_},
-                Stats::Histogram::Unit::Bytes, tags)
+            parent_.histogram(metric.name_, Stats::Histogram::Unit::Bytes, tags)
                 .recordValue(amount);
             break;
           case MetricOverrides::MetricType::Gauge:
-            Stats::Utility::gaugeFromStatNames(*parent_.scope(),
-                                               {parent_.context_->stat_namespace_, metric.name_},
-                                               Stats::Gauge::ImportMode::Accumulate, tags)
-                .set(amount);
+            parent_.gauge(metric.name_, tags).set(amount);
             break;
           default:
             break;
@@ -737,66 +1183,255 @@ struct Config : public Logger::Loggable<Logger::Id::filter> {
     }
 
     Config& parent_;
-    Stats::StatNameDynamicPool& pool_;
-    std::vector<std::pair<Stats::StatName, uint64_t>> expr_values_;
+    TagValuePool& pool_;
+    MetricOverrides::ExprValues expr_values_;
+    // Reused output of the tag transformation.
+    Stats::StatNameTagVector override_tags_;
     bool evaluated_{false};
   };
 
-  void recordVersion(Server::Configuration::FactoryContext& factory_context) {
+  void recordVersion(Stats::Scope& scope) {
     Stats::StatNameTagVector tags;
     tags.push_back({context_->component_, context_->proxy_});
     tags.push_back({context_->tag_, context_->istio_version_.empty() ? context_->unknown_
                                                                      : context_->istio_version_});
 
-    Stats::Utility::gaugeFromStatNames(factory_context.scope(),
-                                       {context_->stat_namespace_, context_->istio_build_},
+    Stats::Utility::gaugeFromStatNames(scope, {context_->stat_namespace_, context_->istio_build_},
                                        Stats::Gauge::ImportMode::Accumulate, tags)
         .set(1);
   }
 
   Reporter reporter() const { return reporter_; }
-  Stats::Scope* scope() { return scope_.scope(); }
+  Stats::Scope* scope() { return scope_->scope(); }
+
+  // Resolves the metric handles in the active scope through the per-worker cache.
+  MetricCache& metricCache() {
+    MetricCache& cache = metric_cache_->get().ref();
+    cache.refresh(*scope_);
+    return cache;
+  }
+  void addCounter(Stats::StatName metric, const Stats::StatNameTagVector& tags, uint64_t amount) {
+    MetricCache& cache = metricCache();
+    cache.addCounter(cache.counter(metric, tags), amount);
+  }
+  Stats::Histogram& histogram(Stats::StatName metric, Stats::Histogram::Unit unit,
+                              const Stats::StatNameTagVector& tags) {
+    return metricCache().histogram(metric, unit, tags);
+  }
+  Stats::Gauge& gauge(Stats::StatName metric, const Stats::StatNameTagVector& tags) {
+    return metricCache().gauge(metric, tags);
+  }
+  TagValueTable& tagValues() { return metric_cache_->get().ref().tagValues(); }
+  PeerTagCache& peerTags() { return metric_cache_->get().ref().peerTags(); }
+  Protobuf::Arena& arena() { return metric_cache_->get().ref().arena(); }
+  ReportWheel& reportWheel() { return report_wheel_->get().ref(); }
+  MetricOverrides::TagPlans& tagPlans() { return metric_cache_->get().ref().tagPlans(); }
+  bool sampleHistograms() {
+    return histogram_sample_rate_ <= 1 ||
+           metric_cache_->get().ref().sampleHistograms(histogram_sample_rate_);
+  }
+  // Hands the request metrics off to the aggregator of the worker. Returns false if the
+  // asynchronous recording is disabled, or if the batch is full, in which case the caller records
+  // the request metrics inline.
+  bool enqueue(StatsRecord&& record) {
+    if (!aggregator_) {
+      return false;
+    }
+    return aggregator_->get().ref().push(std::move(record));
+  }
+  // Applies the request classifiers to the tags of the request metrics. Returns true if the tags
+  // changed.
+  bool classify(const Http::RequestHeaderMap& request_headers, const StreamInfo::StreamInfo& info,
+                Stats::StatNameTagVector& tags) const {
+    if (classifiers_.empty()) {
+      return false;
+    }
+    const absl::string_view method = request_headers.getMethodValue();
+    const absl::string_view path = request_headers.getPathValue();
+    const uint64_t response_code = info.responseCode().value_or(0);
+    bool changed = false;
+    for (const auto& classifier : classifiers_) {
+      const Stats::StatName value = classifier.classify(method, path, response_code);
+      if (!classifier.standard_) {
+        tags.push_back({classifier.tag_, value.empty() ? context_->unknown_ : value});
+        changed = true;
+        continue;
+      }
+      if (value.empty()) {
+        continue;
+      }
+      for (auto& tag : tags) {
+        if (tag.first == classifier.tag_) {
+          tag.second = value;
+          changed = true;
+        }
+      }
+    }
+    return changed;
+  }
+  // Enabled latency phases, with their histogram.
+  struct LatencyPhase {
+    stats::LatencyPhase phase_;
+    Stats::StatName metric_;
+    bool operator==(const LatencyPhase& other) const { return phase_ == other.phase_; }
+  };
+  const std::vector<LatencyPhase>& latencyPhases() const { return latency_phases_; }
+  Stats::StatName latencyPhaseMetric(stats::LatencyPhase phase) const {
+    switch (phase) {
+    case stats::LatencyPhase::DOWNSTREAM_REQUEST:
+      return context_->downstream_request_duration_milliseconds_;
+    case stats::LatencyPhase::UPSTREAM_CONNECTION:
+      return context_->upstream_connection_duration_milliseconds_;
+    case stats::LatencyPhase::UPSTREAM_REQUEST:
+      return context_->upstream_request_duration_milliseconds_;
+    case stats::LatencyPhase::UPSTREAM_SERVICE:
+      return context_->upstream_service_duration_milliseconds_;
+    case stats::LatencyPhase::UPSTREAM_RESPONSE:
+      return context_->upstream_response_duration_milliseconds_;
+    case stats::LatencyPhase::DOWNSTREAM_RESPONSE:
+      return context_->downstream_response_duration_milliseconds_;
+    default:
+      return {};
+    }
+  }
+  bool asyncRecording() const { return aggregator_ != nullptr && metric_overrides_ == nullptr; }
+  // Returns the start time if the report is timed by the self telemetry.
+  absl::optional<MonotonicTime> startReport() {
+    if (self_telemetry_ == nullptr || !metric_cache_->get().ref().sampleReport()) {
+      return absl::nullopt;
+    }
+    return self_telemetry_->now();
+  }
+  void endReport(absl::optional<MonotonicTime> start) {
+    if (start.has_value()) {
+      self_telemetry_->recordReport(start.value());
+    }
+  }
 
   ContextSharedPtr context_;
-  RotatingScope scope_;
-  Reporter reporter_;
+  RotatingScopeSharedPtr scope_;
+  const Reporter reporter_;
 
   const bool disable_host_header_fallback_;
   const std::chrono::milliseconds report_duration_;
+  const uint32_t histogram_sample_rate_;
+  Stats::StatNamePool classification_pool_;
+  std::vector<RequestClassifier> classifiers_;
+  std::vector<LatencyPhase> latency_phases_;
+  SelfTelemetrySharedPtr self_telemetry_;
   std::unique_ptr<MetricOverrides> metric_overrides_;
+  ThreadLocal::TypedSlotPtr<MetricCache> metric_cache_;
+  ThreadLocal::TypedSlotPtr<ReportWheel> report_wheel_;
+  ThreadLocal::TypedSlotPtr<StatsAggregator> aggregator_;
+  OtlpExporterSharedPtr otlp_exporter_;
 };
 
 using ConfigSharedPtr = std::shared_ptr<Config>;
 
+// Registry of the configurations shared by the listeners and the filter chains with an identical
+// filter configuration and reporter, so that the memory and the cost of the listener updates scale
+// with the distinct configurations. Filter chains updated without a configuration change also keep
+// their series. Only accessed on the main thread.
+class ConfigRegistry : public Singleton::Instance, public Logger::Loggable<Logger::Id::filter> {
+public:
+  ConfigSharedPtr getOrCreate(const stats::PluginConfig& proto_config, Reporter reporter,
+                              Server::Configuration::ServerFactoryContext& server_context) {
+    auto& entries = configs_[{MessageUtil::hash(proto_config), reporter}];
+    for (const auto& entry : entries) {
+      if (Protobuf::util::MessageDifferencer::Equals(entry.proto_config_, proto_config)) {
+        ConfigSharedPtr config = entry.config_.lock();
+        if (config) {
+          return config;
+        }
+      }
+    }
+    removeExpired();
+    ConfigSharedPtr config = std::make_shared<Config>(proto_config, reporter, server_context);
+    configs_[{MessageUtil::hash(proto_config), reporter}].push_back({proto_config, config});
+    ENVOY_LOG(debug, "Created Istio stats configuration, {} shared configurations.", size());
+    return config;
+  }
+
+private:
+  struct Entry {
+    stats::PluginConfig proto_config_;
+    std::weak_ptr<Config> config_;
+  };
+
+  void removeExpired() {
+    absl::erase_if(configs_, [](auto& it) {
+      auto& entries = it.second;
+      entries.erase(std::remove_if(entries.begin(), entries.end(),
+                                   [](const Entry& entry) { return entry.config_.expired(); }),
+                    entries.end());
+      return entries.empty();
+    });
+  }
+  size_t size() const {
+    size_t size = 0;
+    for (const auto& [_, entries] : configs_) {
+      size += entries.size();
+    }
+    return size;
+  }
+
+  absl::flat_hash_map<std::pair<size_t, Reporter>, std::vector<Entry>> configs_;
+};
+
+SINGLETON_MANAGER_REGISTRATION(ConfigRegistry)
+
+absl::StatusOr<ConfigSharedPtr>
+getOrCreateConfig(const Protobuf::Message& proto_config,
+                  Server::Configuration::FactoryContext& factory_context) {
+  const auto& typed_config = dynamic_cast<const stats::PluginConfig&>(proto_config);
+  const absl::Status status = validateRequestClassifiers(typed_config);
+  if (!status.ok()) {
+    return status;
+  }
+  Server::Configuration::ServerFactoryContext& server_context =
+      factory_context.serverFactoryContext();
+  // Pinned, since the registry only holds weak references to the configurations.
+  auto registry = server_context.singletonManager().getTyped<ConfigRegistry>(
+      SINGLETON_MANAGER_REGISTERED_NAME(ConfigRegistry),
+      [] { return std::make_shared<ConfigRegistry>(); }, /* pin = */ true);
+  return registry->getOrCreate(typed_config, resolveReporter(typed_config, factory_context),
+                               server_context);
+}
+
+// The filter is specialized for the reporter of the configuration, which is fixed, so that the
+// reporter does not branch per stream.
+template <Reporter ReporterType>
 class IstioStatsFilter : public Http::PassThroughFilter,
                          public AccessLog::Instance,
                          public Network::ReadFilter,
-                         public Network::ConnectionCallbacks {
+                         public Network::ConnectionCallbacks,
+                         public ReportWheel::Target {
 public:
   IstioStatsFilter(ConfigSharedPtr config)
-      : config_(config), context_(*config->context_), pool_(config->scope()->symbolTable()),
+      : config_(config), context_(*config->context_), pool_(config->tagValues()),
         stream_(*config_, pool_) {
     tags_.reserve(25);
-    switch (config_->reporter()) {
-    case Reporter::ServerSidecar:
+    if constexpr (ReporterType == Reporter::ServerSidecar) {
       tags_.push_back({context_.reporter_, context_.destination_});
-      break;
-    case Reporter::ServerGateway:
+    } else if constexpr (ReporterType == Reporter::ServerGateway) {
       tags_.push_back({context_.reporter_, context_.waypoint_});
-      break;
-    case Reporter::ClientSidecar:
+    } else {
       tags_.push_back({context_.reporter_, context_.source_});
-      break;
     }
   }
-  ~IstioStatsFilter() { ASSERT(report_timer_ == nullptr); }
+  ~IstioStatsFilter() override {
+    // The stream or the connection may be destroyed without the final report, e.g. a gRPC stream
+    // reset before the access log, so the wheel must not keep a dangling target.
+    if (report_handle_.has_value()) {
+      config_->reportWheel().remove(report_handle_.value());
+    }
+  }
 
   // Http::StreamDecoderFilter
   Http::FilterHeadersStatus decodeHeaders(Http::RequestHeaderMap& request_headers, bool) override {
     is_grpc_ = Grpc::Common::isGrpcRequestHeaders(request_headers);
     if (is_grpc_) {
-      report_timer_ = decoder_callbacks_->dispatcher().createTimer([this] { onReportTimer(); });
-      report_timer_->enableTimer(config_->report_duration_);
+      report_handle_ = config_->reportWheel().add(*this);
     }
     return Http::FilterHeadersStatus::Continue;
   }
@@ -807,6 +1442,7 @@ public:
     const Http::RequestHeaderMap* request_headers = &log_context.requestHeaders();
     const Http::ResponseHeaderMap* response_headers = &log_context.responseHeaders();
     const Http::ResponseTrailerMap* response_trailers = &log_context.responseTrailers();
+    const auto report_start = config_->startReport();
 
     reportHelper(true);
     if (is_grpc_) {
@@ -815,41 +1451,71 @@ public:
       tags_.push_back({context_.request_protocol_, context_.http_});
     }
 
-    // TODO: copy Http::CodeStatsImpl version for status codes and flags.
-    tags_.push_back(
-        {context_.response_code_, pool_.add(absl::StrCat(info.responseCode().value_or(0)))});
+    // The bounded domains are looked up in the precomputed tables.
+    const uint64_t response_code = info.responseCode().value_or(0);
+    const Stats::StatName response_code_name = context_.responseCode(response_code);
+    // Only the tag values held by the context may outlive the stream in an asynchronous record.
+    bool interned = !response_code_name.empty();
+    tags_.push_back({context_.response_code_, response_code_name.empty()
+                                                  ? pool_.add(absl::StrCat(response_code))
+                                                  : response_code_name});
     if (is_grpc_) {
       auto const& optional_status = Grpc::Common::getGrpcStatus(
           response_trailers ? *response_trailers
                             : *Http::StaticEmptyHeaders::get().response_trailers,
           response_headers ? *response_headers : *Http::StaticEmptyHeaders::get().response_headers,
           info);
-      tags_.push_back(
-          {context_.grpc_response_status_,
-           optional_status ? pool_.add(absl::StrCat(optional_status.value())) : context_.empty_});
+      Stats::StatName grpc_status_name = context_.empty_;
+      if (optional_status) {
+        grpc_status_name = context_.grpcStatus(optional_status.value());
+        if (grpc_status_name.empty()) {
+          interned = false;
+          grpc_status_name = pool_.add(absl::StrCat(optional_status.value()));
+        }
+      }
+      tags_.push_back({context_.grpc_response_status_, grpc_status_name});
     } else {
       tags_.push_back({context_.grpc_response_status_, context_.empty_});
     }
-    populateFlagsAndConnectionSecurity(info);
+    interned = populateFlagsAndConnectionSecurity(info) && interned;
+    // The classified values are interned in the configuration, and may replace the peer tags.
+    interned = !config_->classify(*request_headers, info, tags_) && interned;
 
     // Evaluate the end stream override expressions for HTTP. This may change values for periodic
     // metrics.
-    stream_.evaluate(info, request_headers, response_headers, response_trailers);
-    stream_.addCounter(context_.requests_total_, tags_);
-    auto duration = info.requestComplete();
-    if (duration.has_value()) {
-      stream_.recordHistogram(context_.request_duration_milliseconds_,
-                              Stats::Histogram::Unit::Milliseconds, tags_,
-                              absl::FromChrono(duration.value()) / absl::Milliseconds(1));
-    }
-    auto meter = info.getDownstreamBytesMeter();
-    if (meter) {
-      stream_.recordHistogram(context_.request_bytes_, Stats::Histogram::Unit::Bytes, tags_,
-                              meter->wireBytesReceived());
-      stream_.recordHistogram(context_.response_bytes_, Stats::Histogram::Unit::Bytes, tags_,
-                              meter->wireBytesSent());
+    stream_.evaluate(MetricOverrides::Phase::HttpStreamEnd, info, request_headers,
+                     response_headers, response_trailers);
+    // The counters stay exact, the histograms may be sampled.
+    const bool record_histograms = config_->sampleHistograms();
+    if (!interned || !config_->asyncRecording() || !enqueueRecord(info, record_histograms)) {
+      stream_.addCounter(context_.requests_total_, tags_);
+      if (record_histograms) {
+        auto duration = info.requestComplete();
+        if (duration.has_value()) {
+          stream_.recordHistogram(context_.request_duration_milliseconds_,
+                                  Stats::Histogram::Unit::Milliseconds, tags_,
+                                  absl::FromChrono(duration.value()) / absl::Milliseconds(1));
+        }
+        auto meter = info.getDownstreamBytesMeter();
+        if (meter) {
+          stream_.recordHistogram(context_.request_bytes_, Stats::Histogram::Unit::Bytes, tags_,
+                                  meter->wireBytesReceived());
+          stream_.recordHistogram(context_.response_bytes_, Stats::Histogram::Unit::Bytes, tags_,
+                                  meter->wireBytesSent());
+        }
+      }
+    }
+    if (record_histograms) {
+      for (const auto& phase : config_->latencyPhases()) {
+        const auto duration = latencyPhaseDuration(phase.phase_, info);
+        if (duration.has_value()) {
+          stream_.recordHistogram(phase.metric_, Stats::Histogram::Unit::Milliseconds, tags_,
+                                  absl::FromChrono(duration.value()) / absl::Milliseconds(1));
+        }
+      }
     }
     stream_.recordCustomMetrics();
+    config_->endReport(report_start);
   }
 
   // Network::ReadFilter
@@ -858,9 +1524,7 @@ public:
   }
   Network::FilterStatus onNewConnection() override {
     if (config_->report_duration_ > std::chrono::milliseconds(0)) {
-      report_timer_ = network_read_callbacks_->connection().dispatcher().createTimer(
-          [this] { onReportTimer(); });
-      report_timer_->enableTimer(config_->report_duration_);
+      report_handle_ = config_->reportWheel().add(*this);
     }
     return Network::FilterStatus::Continue;
   }
@@ -872,9 +1536,12 @@ public:
   void onEvent(Network::ConnectionEvent event) override {
     switch (event) {
     case Network::ConnectionEvent::LocalClose:
-    case Network::ConnectionEvent::RemoteClose:
+    case Network::ConnectionEvent::RemoteClose: {
+      const auto report_start = config_->startReport();
       reportHelper(true);
+      config_->endReport(report_start);
       break;
+    }
     default:
       break;
     }
@@ -885,21 +1552,21 @@ public:
 private:
   // Invoked periodically for streams.
   void reportHelper(bool end_stream) {
-    if (end_stream && report_timer_) {
-      report_timer_->disableTimer();
-      report_timer_.reset();
+    if (end_stream && report_handle_.has_value()) {
+      config_->reportWheel().remove(report_handle_.value());
+      report_handle_.reset();
     }
     // HTTP handled first.
     if (decoder_callbacks_) {
       if (!peer_read_) {
         const auto& info = decoder_callbacks_->streamInfo();
-        peer_read_ = peerInfoRead(config_->reporter(), info.filterState());
+        peer_read_ = peerInfoRead(ReporterType, info.filterState());
         if (peer_read_ || end_stream) {
           populatePeerInfo(info, info.filterState());
         }
         if (is_grpc_ && (peer_read_ || end_stream)) {
           // For periodic HTTP metric, evaluate once when the peer info is read.
-          stream_.evaluate(decoder_callbacks_->streamInfo());
+          stream_.evaluate(MetricOverrides::Phase::GrpcMessages, decoder_callbacks_->streamInfo());
         }
       }
       if (is_grpc_ && (peer_read_ || end_stream)) {
@@ -921,7 +1588,7 @@ private:
     const auto& info = network_read_callbacks_->connection().streamInfo();
     // TCP MX writes to upstream stream info instead.
     OptRef<const StreamInfo::UpstreamInfo> upstream_info;
-    if (config_->reporter() == Reporter::ClientSidecar) {
+    if (ReporterType == Reporter::ClientSidecar) {
       upstream_info = info.upstreamInfo();
     }
     const StreamInfo::FilterState& filter_state =
@@ -930,14 +1597,14 @@ private:
             : info.filterState();
 
     if (!peer_read_) {
-      peer_read_ = peerInfoRead(config_->reporter(), filter_state);
+      peer_read_ = peerInfoRead(ReporterType, filter_state);
       // Report connection open once peer info is read or connection is closed.
       if (peer_read_ || end_stream) {
         populatePeerInfo(info, filter_state);
         tags_.push_back({context_.request_protocol_, context_.tcp_});
         populateFlagsAndConnectionSecurity(info);
         // For TCP, evaluate only once immediately before emitting the first metric.
-        stream_.evaluate(info);
+        stream_.evaluate(MetricOverrides::Phase::Tcp, info);
         stream_.addCounter(context_.tcp_connections_opened_total_, tags_);
       }
     }
@@ -957,18 +1624,69 @@ private:
       stream_.recordCustomMetrics();
     }
   }
-  void onReportTimer() {
-    reportHelper(false);
-    report_timer_->enableTimer(config_->report_duration_);
+  // ReportWheel::Target
+  void onPeriodicReport() override {
+    if (hasReportDelta()) {
+      const auto report_start = config_->startReport();
+      reportHelper(false);
+      config_->endReport(report_start);
+    }
+  }
+  // Streams without new bytes or messages since the last report have nothing to add.
+  bool hasReportDelta() const {
+    if (!peer_read_) {
+      return true;
+    }
+    if (decoder_callbacks_) {
+      const auto* counters =
+          decoder_callbacks_->streamInfo()
+              .filterState()
+              ->getDataReadOnly<GrpcStats::GrpcStatsObject>("envoy.filters.http.grpc_stats");
+      return counters && (counters->request_message_count != request_message_count_ ||
+                          counters->response_message_count != response_message_count_);
+    }
+    const auto meter = network_read_callbacks_->connection().streamInfo().getDownstreamBytesMeter();
+    return meter &&
+           (meter->wireBytesSent() != bytes_sent_ || meter->wireBytesReceived() != bytes_received_);
+  }
+
+  // Hands the standard request metrics off to the aggregator. The tags are the reporter, the peer
+  // tag segment and the stream tags, in this order.
+  bool enqueueRecord(const StreamInfo::StreamInfo& info, bool record_histograms) {
+    if (peer_tags_ == nullptr ||
+        tags_.size() != 1 + peer_tags_->tags_.size() + StatsRecord::StreamTags) {
+      return false;
+    }
+    StatsRecord record;
+    record.reporter_ = tags_.front();
+    record.peer_tags_ = peer_tags_;
+    std::copy(tags_.end() - StatsRecord::StreamTags, tags_.end(), record.stream_tags_.begin());
+    record.record_histograms_ = record_histograms;
+    if (record.record_histograms_) {
+      const auto duration = info.requestComplete();
+      if (duration.has_value()) {
+        record.duration_ms_ = absl::FromChrono(duration.value()) / absl::Milliseconds(1);
+      }
+      const auto meter = info.getDownstreamBytesMeter();
+      if (meter) {
+        record.bytes_ = {meter->wireBytesReceived(), meter->wireBytesSent()};
+      }
+    }
+    return config_->enqueue(std::move(record));
   }
 
-  void populateFlagsAndConnectionSecurity(const StreamInfo::StreamInfo& info) {
-    tags_.push_back(
-        {context_.response_flags_, pool_.add(StreamInfo::ResponseFlagUtils::toShortString(info))});
+  // Returns false if the response flags are not interned in the context.
+  bool populateFlagsAndConnectionSecurity(const StreamInfo::StreamInfo& info) {
+    const Stats::StatName response_flags = context_.responseFlags(info);
+    tags_.push_back({context_.response_flags_,
+                     response_flags.empty()
+                         ? pool_.add(StreamInfo::ResponseFlagUtils::toShortString(info))
+                         : response_flags});
     tags_.push_back({context_.connection_security_policy_,
                      mutual_tls_.has_value()
                          ? (*mutual_tls_ ? context_.mutual_tls_ : context_.none_)
                          : context_.unknown_});
+    return !response_flags.empty();
   }
 
   // Peer metadata is populated after encode/decodeHeaders by MX HTTP filter,
@@ -976,13 +1694,14 @@ private:
   void populatePeerInfo(const StreamInfo::StreamInfo& info,
                         const StreamInfo::FilterState& filter_state) {
     // Compute peer info with client-side fallbacks.
-    absl::optional<Istio::Common::WorkloadMetadataObject> peer;
-    const auto* object = peerInfo(config_->reporter(), filter_state);
-    if (object) {
-      peer.emplace(*object);
-    } else if (config_->reporter() == Reporter::ClientSidecar) {
-      if (auto label_obj = extractEndpointMetadata(info); label_obj) {
-        peer.emplace(label_obj.value());
+    // The peer object is borrowed from the filter state; only the endpoint metadata fallback
+    // needs local storage.
+    absl::optional<Istio::Common::WorkloadMetadataObject> endpoint_label_peer;
+    const Istio::Common::WorkloadMetadataObject* peer = peerInfo(ReporterType, filter_state);
+    if (!peer && ReporterType == Reporter::ClientSidecar) {
+      endpoint_label_peer = extractEndpointMetadata(info);
+      if (endpoint_label_peer) {
+        peer = &endpoint_label_peer.value();
       }
     }
 
@@ -1011,29 +1730,16 @@ private:
             cluster_name == "InboundPassthroughClusterIpv6") {
           service_host_name = cluster_name;
         } else {
-          const auto& filter_metadata = cluster_info.value()->metadata().filter_metadata();
-          const auto& it = filter_metadata.find("istio");
-          if (it != filter_metadata.end()) {
-            const auto& services_it = it->second.fields().find("services");
-            if (services_it != it->second.fields().end()) {
-              const auto& services = services_it->second.list_value();
-              if (services.values_size() > 0) {
-                const auto& service = services.values(0).struct_value().fields();
-                const auto& host_it = service.find("host");
-                if (host_it != service.end()) {
-                  service_host = host_it->second.string_value();
-                }
-                const auto& name_it = service.find("name");
-                const auto& namespace_it = service.find("namespace");
-                if (namespace_it != service.end()) {
-                  service_namespace = namespace_it->second.string_value();
-                }
-                if (name_it != service.end()) {
-                  service_host_name = name_it->second.string_value();
-                } else {
-                  service_host_name = service_host.substr(0, service_host.find_first_of('.'));
-                }
-              }
+          const auto* digest = Istio::Common::ClusterMetadataDigest::get(*cluster_info.value());
+          if (digest != nullptr && digest->has_service_) {
+            if (digest->service_host_.has_value()) {
+              service_host = *digest->service_host_;
+            }
+            service_namespace = digest->service_namespace_;
+            if (digest->service_name_.has_value()) {
+              service_host_name = *digest->service_name_;
+            } else {
+              service_host_name = service_host.substr(0, service_host.find_first_of('.'));
             }
           }
         }
@@ -1042,7 +1748,7 @@ private:
 
     absl::string_view peer_san;
     absl::string_view local_san;
-    switch (config_->reporter()) {
+    switch (ReporterType) {
     case Reporter::ServerSidecar:
     case Reporter::ServerGateway: {
       auto peer_principal =
@@ -1092,134 +1798,159 @@ private:
     if (peer_namespace.empty() && peer) {
       peer_namespace = peer->namespace_name_;
     }
-    switch (config_->reporter()) {
+    const PeerTagInputs inputs{
+        peer,
+        ReporterType == Reporter::ServerGateway
+            ? peerInfo(Reporter::ClientSidecar, filter_state)
+            : nullptr,
+        peer_namespace,
+        peer_san,
+        local_san,
+        service_host,
+        service_host_name,
+        service_namespace,
+    };
+    peer_tags_ = config_->peerTags().getOrCreate(
+        inputs, [this, &inputs](Stats::StatNameTagVector& tags, TagValuePool& pool) {
+          buildPeerTags(inputs, tags, pool);
+        });
+    tags_.insert(tags_.end(), peer_tags_->tags_.begin(), peer_tags_->tags_.end());
+  }
+
+  // Appends the tags derived from the peer, the local workload, and the destination service.
+  void buildPeerTags(const PeerTagInputs& inputs, Stats::StatNameTagVector& tags,
+                     TagValuePool& pool) {
+    const auto* peer = inputs.peer_;
+    const auto* endpoint_peer = inputs.endpoint_peer_;
+    const absl::string_view peer_namespace = inputs.peer_namespace_;
+    const absl::string_view peer_san = inputs.peer_san_;
+    const absl::string_view local_san = inputs.local_san_;
+    const absl::string_view service_host = inputs.service_host_;
+    const absl::string_view service_host_name = inputs.service_host_name_;
+    const absl::string_view service_namespace = inputs.service_namespace_;
+    switch (ReporterType) {
     case Reporter::ServerSidecar:
     case Reporter::ServerGateway: {
-      tags_.push_back({context_.source_workload_, peer && !peer->workload_name_.empty()
-                                                      ? pool_.add(peer->workload_name_)
-                                                      : context_.unknown_});
-      tags_.push_back({context_.source_canonical_service_, peer && !peer->canonical_name_.empty()
-                                                               ? pool_.add(peer->canonical_name_)
-                                                               : context_.unknown_});
-      tags_.push_back(
+      tags.push_back({context_.source_workload_, peer && !peer->workload_name_.empty()
+                                                     ? pool.add(peer->workload_name_)
+                                                     : context_.unknown_});
+      tags.push_back({context_.source_canonical_service_, peer && !peer->canonical_name_.empty()
+                                                              ? pool.add(peer->canonical_name_)
+                                                              : context_.unknown_});
+      tags.push_back(
           {context_.source_canonical_revision_, peer && !peer->canonical_revision_.empty()
-                                                    ? pool_.add(peer->canonical_revision_)
+                                                    ? pool.add(peer->canonical_revision_)
                                                     : context_.latest_});
-      tags_.push_back({context_.source_workload_namespace_,
-                       !peer_namespace.empty() ? pool_.add(peer_namespace) : context_.unknown_});
-      tags_.push_back({context_.source_principal_,
-                       !peer_san.empty() ? pool_.add(peer_san) : context_.unknown_});
-      tags_.push_back({context_.source_app_, peer && !peer->app_name_.empty()
-                                                 ? pool_.add(peer->app_name_)
-                                                 : context_.unknown_});
-      tags_.push_back({context_.source_version_, peer && !peer->app_version_.empty()
-                                                     ? pool_.add(peer->app_version_)
-                                                     : context_.unknown_});
-      tags_.push_back({context_.source_cluster_, peer && !peer->cluster_name_.empty()
-                                                     ? pool_.add(peer->cluster_name_)
-                                                     : context_.unknown_});
-      switch (config_->reporter()) {
+      tags.push_back({context_.source_workload_namespace_,
+                      !peer_namespace.empty() ? pool.add(peer_namespace) : context_.unknown_});
+      tags.push_back({context_.source_principal_,
+                      !peer_san.empty() ? pool.add(peer_san) : context_.unknown_});
+      tags.push_back({context_.source_app_, peer && !peer->app_name_.empty()
+                                                ? pool.add(peer->app_name_)
+                                                : context_.unknown_});
+      tags.push_back({context_.source_version_, peer && !peer->app_version_.empty()
+                                                    ? pool.add(peer->app_version_)
+                                                    : context_.unknown_});
+      tags.push_back({context_.source_cluster_, peer && !peer->cluster_name_.empty()
+                                                    ? pool.add(peer->cluster_name_)
+                                                    : context_.unknown_});
+      switch (ReporterType) {
       case Reporter::ServerGateway: {
-        std::optional<Istio::Common::WorkloadMetadataObject> endpoint_peer;
-        const auto* endpoint_object = peerInfo(Reporter::ClientSidecar, filter_state);
-        if (endpoint_object) {
-          endpoint_peer.emplace(*endpoint_object);
-        }
-        tags_.push_back(
+        tags.push_back(
             {context_.destination_workload_,
-             endpoint_peer ? pool_.add(endpoint_peer->workload_name_) : context_.unknown_});
-        tags_.push_back({context_.destination_workload_namespace_,
-                         endpoint_peer && !endpoint_peer->namespace_name_.empty()
-                             ? pool_.add(endpoint_peer->namespace_name_)
-                             : context_.unknown_});
-        tags_.push_back({context_.destination_principal_,
-                         endpoint_peer ? pool_.add(endpoint_peer->identity_) : context_.unknown_});
+             endpoint_peer ? pool.add(endpoint_peer->workload_name_) : context_.unknown_});
+        tags.push_back({context_.destination_workload_namespace_,
+                        endpoint_peer && !endpoint_peer->namespace_name_.empty()
+                            ? pool.add(endpoint_peer->namespace_name_)
+                            : context_.unknown_});
+        tags.push_back({context_.destination_principal_,
+                        endpoint_peer ? pool.add(endpoint_peer->identity_) : context_.unknown_});
         // Endpoint encoding does not have app and version.
-        tags_.push_back(
+        tags.push_back(
             {context_.destination_app_, endpoint_peer && !endpoint_peer->app_name_.empty()
-                                            ? pool_.add(endpoint_peer->app_name_)
+                                            ? pool.add(endpoint_peer->app_name_)
                                             : context_.unknown_});
-        tags_.push_back({context_.destination_version_, endpoint_peer
-                                                            ? pool_.add(endpoint_peer->app_version_)
-                                                            : context_.unknown_});
+        tags.push_back({context_.destination_version_, endpoint_peer
+                                                           ? pool.add(endpoint_peer->app_version_)
+                                                           : context_.unknown_});
         auto canonical_name =
-            endpoint_peer ? pool_.add(endpoint_peer->canonical_name_) : context_.unknown_;
-        tags_.push_back({context_.destination_service_,
-                         service_host.empty() ? canonical_name : pool_.add(service_host)});
-        tags_.push_back({context_.destination_canonical_service_, canonical_name});
-        tags_.push_back(
+            endpoint_peer ? pool.add(endpoint_peer->canonical_name_) : context_.unknown_;
+        tags.push_back({context_.destination_service_,
+                        service_host.empty() ? canonical_name : pool.add(service_host)});
+        tags.push_back({context_.destination_canonical_service_, canonical_name});
+        tags.push_back(
             {context_.destination_canonical_revision_,
-             endpoint_peer ? pool_.add(endpoint_peer->canonical_revision_) : context_.unknown_});
-        tags_.push_back({context_.destination_service_name_, service_host_name.empty()
-                                                                 ? canonical_name
-                                                                 : pool_.add(service_host_name)});
+             endpoint_peer ? pool.add(endpoint_peer->canonical_revision_) : context_.unknown_});
+        tags.push_back({context_.destination_service_name_, service_host_name.empty()
+                                                                ? canonical_name
+                                                                : pool.add(service_host_name)});
         break;
       }
       default:
-        tags_.push_back({context_.destination_workload_, context_.workload_name_});
-        tags_.push_back({context_.destination_workload_namespace_, context_.namespace_});
-        tags_.push_back({context_.destination_principal_,
-                         !local_san.empty() ? pool_.add(local_san) : context_.unknown_});
-        tags_.push_back({context_.destination_app_, context_.app_name_});
-        tags_.push_back({context_.destination_version_, context_.app_version_});
-        tags_.push_back({context_.destination_service_, service_host.empty()
-                                                            ? context_.canonical_name_
-                                                            : pool_.add(service_host)});
-        tags_.push_back({context_.destination_canonical_service_, context_.canonical_name_});
-        tags_.push_back({context_.destination_canonical_revision_, context_.canonical_revision_});
-        tags_.push_back({context_.destination_service_name_, service_host_name.empty()
-                                                                 ? context_.canonical_name_
-                                                                 : pool_.add(service_host_name)});
+        tags.push_back({context_.destination_workload_, context_.workload_name_});
+        tags.push_back({context_.destination_workload_namespace_, context_.namespace_});
+        tags.push_back({context_.destination_principal_,
+                        !local_san.empty() ? pool.add(local_san) : context_.unknown_});
+        tags.push_back({context_.destination_app_, context_.app_name_});
+        tags.push_back({context_.destination_version_, context_.app_version_});
+        tags.push_back({context_.destination_service_, service_host.empty()
+                                                           ? context_.canonical_name_
+                                                           : pool.add(service_host)});
+        tags.push_back({context_.destination_canonical_service_, context_.canonical_name_});
+        tags.push_back({context_.destination_canonical_revision_, context_.canonical_revision_});
+        tags.push_back({context_.destination_service_name_, service_host_name.empty()
+                                                                ? context_.canonical_name_
+                                                                : pool.add(service_host_name)});
         break;
       }
-      tags_.push_back({context_.destination_service_namespace_, context_.namespace_});
-      tags_.push_back({context_.destination_cluster_, context_.cluster_name_});
+      tags.push_back({context_.destination_service_namespace_, context_.namespace_});
+      tags.push_back({context_.destination_cluster_, context_.cluster_name_});
 
       break;
     }
     case Reporter::ClientSidecar: {
-      tags_.push_back({context_.source_workload_, context_.workload_name_});
-      tags_.push_back({context_.source_canonical_service_, context_.canonical_name_});
-      tags_.push_back({context_.source_canonical_revision_, context_.canonical_revision_});
-      tags_.push_back({context_.source_workload_namespace_, context_.namespace_});
-      tags_.push_back({context_.source_principal_,
-                       !local_san.empty() ? pool_.add(local_san) : context_.unknown_});
-      tags_.push_back({context_.source_app_, context_.app_name_});
-      tags_.push_back({context_.source_version_, context_.app_version_});
-      tags_.push_back({context_.source_cluster_, context_.cluster_name_});
-      tags_.push_back({context_.destination_workload_, peer && !peer->workload_name_.empty()
-                                                           ? pool_.add(peer->workload_name_)
-                                                           : context_.unknown_});
-      tags_.push_back({context_.destination_workload_namespace_,
-                       !peer_namespace.empty() ? pool_.add(peer_namespace) : context_.unknown_});
-      tags_.push_back({context_.destination_principal_,
-                       !peer_san.empty() ? pool_.add(peer_san) : context_.unknown_});
-      tags_.push_back({context_.destination_app_, peer && !peer->app_name_.empty()
-                                                      ? pool_.add(peer->app_name_)
-                                                      : context_.unknown_});
-      tags_.push_back({context_.destination_version_, peer && !peer->app_version_.empty()
-                                                          ? pool_.add(peer->app_version_)
+      tags.push_back({context_.source_workload_, context_.workload_name_});
+      tags.push_back({context_.source_canonical_service_, context_.canonical_name_});
+      tags.push_back({context_.source_canonical_revision_, context_.canonical_revision_});
+      tags.push_back({context_.source_workload_namespace_, context_.namespace_});
+      tags.push_back({context_.source_principal_,
+                      !local_san.empty() ? pool.add(local_san) : context_.unknown_});
+      tags.push_back({context_.source_app_, context_.app_name_});
+      tags.push_back({context_.source_version_, context_.app_version_});
+      tags.push_back({context_.source_cluster_, context_.cluster_name_});
+      tags.push_back({context_.destination_workload_, peer && !peer->workload_name_.empty()
+                                                          ? pool.add(peer->workload_name_)
                                                           : context_.unknown_});
-      tags_.push_back({context_.destination_service_,
-                       service_host.empty() ? context_.unknown_ : pool_.add(service_host)});
-      tags_.push_back({context_.destination_canonical_service_,
-                       peer && !peer->canonical_name_.empty() ? pool_.add(peer->canonical_name_)
-                                                              : context_.unknown_});
-      tags_.push_back(
+      tags.push_back({context_.destination_workload_namespace_,
+                      !peer_namespace.empty() ? pool.add(peer_namespace) : context_.unknown_});
+      tags.push_back({context_.destination_principal_,
+                      !peer_san.empty() ? pool.add(peer_san) : context_.unknown_});
+      tags.push_back({context_.destination_app_, peer && !peer->app_name_.empty()
+                                                     ? pool.add(peer->app_name_)
+                                                     : context_.unknown_});
+      tags.push_back({context_.destination_version_, peer && !peer->app_version_.empty()
+                                                         ? pool.add(peer->app_version_)
+                                                         : context_.unknown_});
+      tags.push_back({context_.destination_service_,
+                      service_host.empty() ? context_.unknown_ : pool.add(service_host)});
+      tags.push_back({context_.destination_canonical_service_,
+                      peer && !peer->canonical_name_.empty() ? pool.add(peer->canonical_name_)
+                                                             : context_.unknown_});
+      tags.push_back(
           {context_.destination_canonical_revision_, peer && !peer->canonical_revision_.empty()
-                                                         ? pool_.add(peer->canonical_revision_)
+                                                         ? pool.add(peer->canonical_revision_)
                                                          : context_.latest_});
-      tags_.push_back({context_.destination_service_name_, service_host_name.empty()
-                                                               ? context_.unknown_
-                                                               : pool_.add(service_host_name)});
-      tags_.push_back(
+      tags.push_back({context_.destination_service_name_, service_host_name.empty()
+                                                              ? context_.unknown_
+                                                              : pool.add(service_host_name)});
+      tags.push_back(
           {context_.destination_service_namespace_,
            !service_namespace.empty()
-               ? pool_.add(service_namespace)
-               : (!peer_namespace.empty() ? pool_.add(peer_namespace) : context_.unknown_)});
-      tags_.push_back({context_.destination_cluster_, peer && !peer->cluster_name_.empty()
-                                                          ? pool_.add(peer->cluster_name_)
-                                                          : context_.unknown_});
+               ? pool.add(service_namespace)
+               : (!peer_namespace.empty() ? pool.add(peer_namespace) : context_.unknown_)});
+      tags.push_back({context_.destination_cluster_, peer && !peer->cluster_name_.empty()
+                                                         ? pool.add(peer->cluster_name_)
+                                                         : context_.unknown_});
       break;
     }
     default:
@@ -1229,9 +1960,10 @@ private:
 
   ConfigSharedPtr config_;
   Context& context_;
-  Stats::StatNameDynamicPool pool_;
+  TagValuePool pool_;
   Stats::StatNameTagVector tags_;
-  Event::TimerPtr report_timer_{nullptr};
+  PeerTagBlockSharedPtr peer_tags_;
+  absl::optional<ReportWheel::Handle> report_handle_;
   Network::ReadFilterCallbacks* network_read_callbacks_;
   bool peer_read_{false};
   uint64_t bytes_sent_{0};
@@ -1244,6 +1976,19 @@ private:
   Config::StreamOverrides stream_;
 };
 
+// Calls create with the reporter of the configuration as a compile-time constant.
+template <class Create> auto withReporter(Reporter reporter, Create create) {
+  switch (reporter) {
+  case Reporter::ServerSidecar:
+    return create(std::integral_constant<Reporter, Reporter::ServerSidecar>());
+  case Reporter::ServerGateway:
+    return create(std::integral_constant<Reporter, Reporter::ServerGateway>());
+  case Reporter::ClientSidecar:
+    break;
+  }
+  return create(std::integral_constant<Reporter, Reporter::ClientSidecar>());
+}
+
 } // namespace
 
 absl::StatusOr<Http::FilterFactoryCb> IstioStatsFilterConfigFactory::createFilterFactoryFromProto(
@@ -1251,15 +1996,21 @@ absl::StatusOr<Http::FilterFactoryCb> IstioStatsFilterConfigFactory::createFilte
     Server::Configuration::FactoryContext& factory_context) {
   factory_context.serverFactoryContext().api().customStatNamespaces().registerStatNamespace(
       CustomStatNamespace);
-  ConfigSharedPtr config = std::make_shared<Config>(
-      dynamic_cast<const stats::PluginConfig&>(proto_config), factory_context);
-  return [config](Http::FilterChainFactoryCallbacks& callbacks) {
-    auto filter = std::make_shared<IstioStatsFilter>(config);
-    callbacks.addStreamFilter(filter);
-    // Wasm filters inject filter state in access log handlers, which are called
-    // after onStreamComplete.
-    callbacks.addAccessLogHandler(filter);
-  };
+  absl::StatusOr<ConfigSharedPtr> config_or_error =
+      getOrCreateConfig(proto_config, factory_context);
+  if (!config_or_error.ok()) {
+    return config_or_error.status();
+  }
+  ConfigSharedPtr config = std::move(config_or_error.value());
+  return withReporter(config->reporter(), [&config](auto reporter) -> Http::FilterFactoryCb {
+    return [config](Http::FilterChainFactoryCallbacks& callbacks) {
+      auto filter = std::make_shared<IstioStatsFilter<decltype(reporter)::value>>(config);
+      callbacks.addStreamFilter(filter);
+      // Wasm filters inject filter state in access log handlers, which are called
+      // after onStreamComplete.
+      callbacks.addAccessLogHandler(filter);
+    };
+  });
 }
 
 REGISTER_FACTORY(IstioStatsFilterConfigFactory,
@@ -1270,11 +2021,18 @@ IstioStatsNetworkFilterConfigFactory::createFilterFactoryFromProto(
     const Protobuf::Message& proto_config, Server::Configuration::FactoryContext& factory_context) {
   factory_context.serverFactoryContext().api().customStatNamespaces().registerStatNamespace(
       CustomStatNamespace);
-  ConfigSharedPtr config = std::make_shared<Config>(
-      dynamic_cast<const stats::PluginConfig&>(proto_config), factory_context);
-  return [config](Network::FilterManager& filter_manager) {
-    filter_manager.addReadFilter(std::make_shared<IstioStatsFilter>(config));
-  };
+  absl::StatusOr<ConfigSharedPtr> config_or_error =
+      getOrCreateConfig(proto_config, factory_context);
+  if (!config_or_error.ok()) {
+    return config_or_error.status();
+  }
+  ConfigSharedPtr config = std::move(config_or_error.value());
+  return withReporter(config->reporter(), [&config](auto reporter) -> Network::FilterFactoryCb {
+    return [config](Network::FilterManager& filter_manager) {
+      filter_manager.addReadFilter(
+          std::make_shared<IstioStatsFilter<decltype(reporter)::value>>(config));
+    };
+  });
 }
 
 REGISTER_FACTORY(IstioStatsNetworkFilterConfigFactory,
@@ -0,0 +1,238 @@
+// Copyright Istio Authors. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+// Benchmarks of the per-request cost of the istio_stats filter. Each iteration creates the filter
+// and completes one HTTP request or TCP connection, like the filter chain does.
+//
+// Besides the time per request, the cases report the bytes retained per request, as seen by the
+// allocator, and the number of series created in the stats store. The retained bytes catch the
+// per-request growth, e.g. of the caches, but not the allocation churn: the bytes allocated and
+// released within a request are not counted.
+//
+// The configurations are deliberately kept separate from testdata/stats. Those are templates of the
+// end-to-end tests, rendered by the Go driver with the test parameters, so they cannot be loaded
+// here. The copies below mirror their shape and are reduced to what changes the per-request cost.
+
+#include "source/extensions/filters/http/istio_stats/istio_stats.h"
+
+#include <iterator>
+
+#include "source/common/memory/stats.h"
+#include "test/mocks/http/mocks.h"
+#include "test/mocks/network/mocks.h"
+#include "test/mocks/server/factory_context.h"
+#include "test/mocks/stream_info/mocks.h"
+#include "test/test_common/utility.h"
+
+#include "extensions/common/metadata_object.h"
+
+#include "benchmark/benchmark.h"
+
+namespace Envoy {
+namespace Extensions {
+namespace HttpFilters {
+namespace IstioStats {
+namespace {
+
+// Reduced copies of client_config.yaml, client_config_customized.yaml.tmpl,
+// client_config_grpc.yaml.tmpl and server_waypoint_proxy_config.yaml in testdata/stats.
+constexpr absl::string_view DefaultConfig = "{}";
+
+constexpr absl::string_view CustomizedConfig = R"EOF(
+definitions:
+- name: custom
+  value: "1"
+  type: COUNTER
+metrics:
+- name: request_duration_milliseconds
+  drop: true
+- name: custom
+  dimensions:
+    reporter: "'proxy'"
+- tags_to_remove:
+  - response_flags
+  - source_principal
+- name: requests_total
+  dimensions:
+    configurable_metric_a: "'gateway'"
+    source_workload: "'_' + xds.node.metadata['WORKLOAD_NAME']"
+    source_app: "'_' + xds.node.metadata['LABELS'].app"
+    request_protocol: request.protocol
+    destination_service_namespace: "'_' + filter_state.upstream_peer.service"
+  tags_to_remove:
+  - grpc_response_status
+- name: request_bytes
+  dimensions:
+    configurable_metric_b: "'test'"
+  tags_to_remove:
+  - reporter
+)EOF";
+
+constexpr absl::string_view GrpcConfig = R"EOF(
+metrics:
+- dimensions:
+    configurable_metric_a: xds.node.metadata.LABELS.version
+)EOF";
+
+constexpr absl::string_view WaypointConfig = R"EOF(
+reporter: SERVER_GATEWAY
+tcp_reporting_duration: 1s
+)EOF";
+
+enum class Direction { Outbound, Inbound };
+
+struct BenchmarkCase {
+  absl::string_view config_;
+  Direction direction_;
+};
+
+// Indexed by the benchmark argument.
+const BenchmarkCase Cases[] = {
+    {DefaultConfig, Direction::Outbound},    // client
+    {CustomizedConfig, Direction::Outbound}, // client, customized
+    {GrpcConfig, Direction::Outbound},       // client, dimensions
+    {DefaultConfig, Direction::Inbound},     // server
+    {WaypointConfig, Direction::Inbound},    // waypoint
+};
+
+const char* const CaseLabels[] = {"client", "client_customized", "client_grpc", "server",
+                                  "waypoint"};
+
+class BenchmarkContext {
+public:
+  explicit BenchmarkContext(const BenchmarkCase& benchmark_case)
+      : peer_key_(benchmark_case.direction_ == Direction::Outbound
+                      ? Istio::Common::UpstreamPeer
+                      : Istio::Common::DownstreamPeer) {
+    ON_CALL(factory_context_.listener_info_, direction())
+        .WillByDefault(testing::Return(benchmark_case.direction_ == Direction::Outbound
+                                           ? envoy::config::core::v3::OUTBOUND
+                                           : envoy::config::core::v3::INBOUND));
+    stats::PluginConfig proto_config;
+    TestUtility::loadFromYaml(std::string(benchmark_case.config_), proto_config);
+    http_factory_ =
+        IstioStatsFilterConfigFactory().createFilterFactoryFromProto(proto_config, "",
+                                                                     factory_context_)
+            .value();
+    network_factory_ = IstioStatsNetworkFilterConfigFactory()
+                           .createFilterFactoryFromProto(proto_config, factory_context_)
+                           .value();
+    ON_CALL(http_callbacks_, addStreamFilter(testing::_))
+        .WillByDefault(testing::SaveArg<0>(&http_filter_));
+    ON_CALL(http_callbacks_, addAccessLogHandler(testing::_))
+        .WillByDefault(testing::SaveArg<0>(&access_log_));
+    ON_CALL(filter_manager_, addReadFilter(testing::_))
+        .WillByDefault(testing::SaveArg<0>(&read_filter_));
+
+    peer_ = std::make_shared<Istio::Common::WorkloadMetadataObject>(
+        "ratings-v1-1234", "server-cluster", "default", "ratings-v1", "ratings", "version-1",
+        "ratings", "v1", Istio::Common::WorkloadType::Deployment,
+        "spiffe://cluster.local/ns/default/sa/ratings");
+    request_headers_ = {{":method", "GET"}, {":path", "/"}, {":authority", "ratings"}};
+    response_headers_ = {{":status", "200"}};
+  }
+
+  void httpRequest() {
+    auto& info = decoder_callbacks_.stream_info_;
+    info.filter_state_ = std::make_shared<StreamInfo::FilterStateImpl>(
+        StreamInfo::FilterState::LifeSpan::FilterChain);
+    info.filter_state_->setData(peer_key_, peer_, StreamInfo::FilterState::StateType::ReadOnly,
+                                StreamInfo::FilterState::LifeSpan::FilterChain);
+    info.response_code_ = 200;
+    http_factory_(http_callbacks_);
+    http_filter_->setDecoderFilterCallbacks(decoder_callbacks_);
+    http_filter_->decodeHeaders(request_headers_, true);
+    const Formatter::HttpFormatterContext log_context(&request_headers_, &response_headers_,
+                                                      &response_trailers_);
+    access_log_->log(log_context, info);
+    http_filter_->onDestroy();
+    http_filter_.reset();
+    access_log_.reset();
+  }
+
+  void tcpConnection() {
+    auto& info = read_callbacks_.connection_.stream_info_;
+    info.filter_state_ = std::make_shared<StreamInfo::FilterStateImpl>(
+        StreamInfo::FilterState::LifeSpan::Connection);
+    info.filter_state_->setData(peer_key_, peer_, StreamInfo::FilterState::StateType::ReadOnly,
+                                StreamInfo::FilterState::LifeSpan::Connection);
+    network_factory_(filter_manager_);
+    read_filter_->initializeReadFilterCallbacks(read_callbacks_);
+    read_filter_->onNewConnection();
+    dynamic_cast<Network::ConnectionCallbacks&>(*read_filter_)
+        .onEvent(Network::ConnectionEvent::RemoteClose);
+    read_filter_.reset();
+  }
+
+  uint64_t series() {
+    auto& store = factory_context_.server_factory_context_.store_;
+    return store.counters().size() + store.gauges().size() + store.histograms().size();
+  }
+
+private:
+  testing::NiceMock<Server::Configuration::MockFactoryContext> factory_context_;
+  Http::FilterFactoryCb http_factory_;
+  Network::FilterFactoryCb network_factory_;
+
+  testing::NiceMock<Http::MockFilterChainFactoryCallbacks> http_callbacks_;
+  testing::NiceMock<Http::MockStreamDecoderFilterCallbacks> decoder_callbacks_;
+  Http::StreamFilterSharedPtr http_filter_;
+  AccessLog::InstanceSharedPtr access_log_;
+  Http::TestRequestHeaderMapImpl request_headers_;
+  Http::TestResponseHeaderMapImpl response_headers_;
+  Http::TestResponseTrailerMapImpl response_trailers_;
+
+  testing::NiceMock<Network::MockFilterManager> filter_manager_;
+  testing::NiceMock<Network::MockReadFilterCallbacks> read_callbacks_;
+  Network::ReadFilterSharedPtr read_filter_;
+
+  const absl::string_view peer_key_;
+  std::shared_ptr<Istio::Common::WorkloadMetadataObject> peer_;
+};
+
+template <class Run> void runBenchmark(benchmark::State& state, Run run) {
+  const size_t index = state.range(0);
+  BenchmarkContext context(Cases[index]);
+  state.SetLabel(CaseLabels[index]);
+  // Warms up the caches, so that the first request does not dominate short runs.
+  run(context);
+  const uint64_t series = context.series();
+  const uint64_t allocated = Memory::Stats::totalCurrentlyAllocated();
+  for (auto _ : state) { // NOLINT(clang-analyzer-deadcode.DeadStores)
+    run(context);
+  }
+  // The allocator only reports the bytes in use, so this is the retained memory, not the churn.
+  state.counters["retained_bytes_per_request"] =
+      benchmark::Counter(static_cast<double>(Memory::Stats::totalCurrentlyAllocated()) -
+                             static_cast<double>(allocated),
+                         benchmark::Counter::kAvgIterations);
+  state.counters["series"] = series;
+}
+
+void bmHttpRequest(benchmark::State& state) {
+  runBenchmark(state, [](BenchmarkContext& context) { context.httpRequest(); });
+}
+BENCHMARK(bmHttpRequest)->DenseRange(0, std::size(Cases) - 1);
+
+void bmTcpConnection(benchmark::State& state) {
+  runBenchmark(state, [](BenchmarkContext& context) { context.tcpConnection(); });
+}
+// The customized and the gRPC configurations only differ for HTTP.
+BENCHMARK(bmTcpConnection)->Arg(0)->Arg(3)->Arg(4);
+
+} // namespace
+} // namespace IstioStats
+} // namespace HttpFilters
+} // namespace Extensions
+} // namespace Envoy
@@ -0,0 +1,547 @@
+// Copyright Istio Authors. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "source/extensions/filters/http/istio_stats/istio_stats.h"
+
+#include "source/common/stats/isolated_store_impl.h"
+#include "source/extensions/filters/http/istio_stats/cardinality_limiter.h"
+#include "source/extensions/filters/http/istio_stats/expression_cache.h"
+#include "source/extensions/filters/http/istio_stats/metric_cache.h"
+#include "source/extensions/filters/http/istio_stats/metric_overrides.h"
+#include "source/extensions/filters/http/istio_stats/report_wheel.h"
+#include "source/extensions/filters/http/istio_stats/self_telemetry.h"
+#include "source/extensions/filters/http/istio_stats/tag_value_table.h"
+#include "test/mocks/event/mocks.h"
+#include "test/mocks/server/factory_context.h"
+#include "test/mocks/server/server_factory_context.h"
+#include "test/test_common/simulated_time_system.h"
+#include "test/test_common/utility.h"
+
+#include "gmock/gmock.h"
+#include "gtest/gtest.h"
+
+using testing::_;
+using testing::ElementsAre;
+using testing::HasSubstr;
+using testing::IsEmpty;
+using testing::Property;
+
+namespace Envoy {
+namespace Extensions {
+namespace HttpFilters {
+namespace IstioStats {
+namespace {
+
+class IstioStatsConfigTest : public testing::Test {
+protected:
+  absl::Status createHttpFilterFactory(const std::string& yaml_config) {
+    stats::PluginConfig proto_config;
+    TestUtility::loadFromYaml(yaml_config, proto_config);
+    return IstioStatsFilterConfigFactory()
+        .createFilterFactoryFromProto(proto_config, "", context_)
+        .status();
+  }
+  absl::Status createNetworkFilterFactory(const std::string& yaml_config) {
+    stats::PluginConfig proto_config;
+    TestUtility::loadFromYaml(yaml_config, proto_config);
+    return IstioStatsNetworkFilterConfigFactory()
+        .createFilterFactoryFromProto(proto_config, context_)
+        .status();
+  }
+
+  testing::NiceMock<Server::Configuration::MockFactoryContext> context_;
+};
+
+TEST_F(IstioStatsConfigTest, ClassifierDoubleWildcardLastSegment) {
+  const std::string yaml_config = R"EOF(
+request_classifiers:
+- tag: request_operation
+  rules:
+  - value: ListReviews
+    paths: ["/reviews/**", "/**"]
+)EOF";
+  EXPECT_TRUE(createHttpFilterFactory(yaml_config).ok());
+  EXPECT_TRUE(createNetworkFilterFactory(yaml_config).ok());
+}
+
+TEST_F(IstioStatsConfigTest, ClassifierDoubleWildcardNotLastSegment) {
+  const std::string yaml_config = R"EOF(
+request_classifiers:
+- tag: request_operation
+  rules:
+  - value: GetRatings
+    paths: ["/reviews/**/ratings"]
+)EOF";
+  for (const absl::Status& status :
+       {createHttpFilterFactory(yaml_config), createNetworkFilterFactory(yaml_config)}) {
+    EXPECT_EQ(status.code(), absl::StatusCode::kInvalidArgument);
+    EXPECT_THAT(status.message(), HasSubstr("GetRatings"));
+    EXPECT_THAT(status.message(), HasSubstr("\"**\" is not the last segment"));
+  }
+}
+
+TEST_F(IstioStatsConfigTest, ClassifierInvalidResponseCodeRange) {
+  const absl::Status status = createHttpFilterFactory(R"EOF(
+request_classifiers:
+- tag: response_class
+  rules:
+  - value: 4xx
+    response_code_min: 500
+    response_code_max: 499
+)EOF");
+  EXPECT_EQ(status.code(), absl::StatusCode::kInvalidArgument);
+  EXPECT_THAT(status.message(), HasSubstr("invalid response code range"));
+}
+
+// Fixture of the components shared by the workers, backed by the isolated store of the server.
+class IstioStatsComponentTest : public testing::Test {
+protected:
+  uint64_t counterValue(const std::string& name) {
+    const Stats::CounterSharedPtr counter = TestUtility::findCounter(server_context_.store_, name);
+    return counter != nullptr ? counter->value() : 0;
+  }
+  uint64_t gaugeValue(const std::string& name) {
+    const Stats::GaugeSharedPtr gauge = TestUtility::findGauge(server_context_.store_, name);
+    return gauge != nullptr ? gauge->value() : 0;
+  }
+  CardinalityLimiterSharedPtr createLimiter(const std::string& yaml_config) {
+    stats::PluginConfig proto_config;
+    TestUtility::loadFromYaml(yaml_config, proto_config);
+    return std::make_shared<CardinalityLimiter>(proto_config, server_context_.scope(), context_);
+  }
+  Stats::StatNameTagVector workloadTags(uint64_t value) {
+    return {{context_->source_workload_, pool_.add(absl::StrCat("workload-", value))}};
+  }
+
+  testing::NiceMock<Server::Configuration::MockServerFactoryContext> server_context_;
+  ContextSharedPtr context_{std::make_shared<Context>(server_context_.scope().symbolTable(),
+                                                      server_context_.localInfo())};
+  Stats::StatNamePool pool_{server_context_.scope().symbolTable()};
+};
+
+class MetricCacheTest : public IstioStatsComponentTest {
+protected:
+  std::unique_ptr<MetricCache>
+  createCache(CardinalityLimiterSharedPtr limiter = nullptr,
+              std::chrono::milliseconds flush_interval = std::chrono::milliseconds(0)) {
+    auto cache = std::make_unique<MetricCache>(server_context_.dispatcher_, context_,
+                                               flush_interval, server_context_.scope(),
+                                               tag_value_stats_, limiter, self_telemetry_);
+    cache->refresh(rotating_scope_);
+    return cache;
+  }
+  // The handles are not recorded, so every lookup past the cache counts as a created series.
+  uint64_t seriesCreated() { return counterValue("istio_stats.self.series_created"); }
+
+  // Without the rotation.
+  RotatingScope rotating_scope_{server_context_, 0, 0, 0};
+  TagValueCacheStatsSharedPtr tag_value_stats_{
+      std::make_shared<TagValueCacheStatsHolder>(server_context_.scope())};
+  SelfTelemetrySharedPtr self_telemetry_{std::make_shared<SelfTelemetry>(server_context_, 0)};
+};
+
+TEST_F(MetricCacheTest, CachedHandle) {
+  auto cache = createCache();
+  Stats::Counter& counter = cache->counter(context_->requests_total_, workloadTags(0));
+  EXPECT_EQ(1, seriesCreated());
+  EXPECT_EQ(&counter, &cache->counter(context_->requests_total_, workloadTags(0)));
+  EXPECT_EQ(1, seriesCreated());
+  // Distinct tags and metric types are distinct entries.
+  cache->counter(context_->requests_total_, workloadTags(1));
+  cache->histogram(context_->request_bytes_, Stats::Histogram::Unit::Bytes, workloadTags(0));
+  EXPECT_EQ(3, seriesCreated());
+}
+
+TEST_F(MetricCacheTest, ClearedWhenFull) {
+  auto cache = createCache();
+  for (uint64_t i = 0; i < MetricCache::MaxEntries; i++) {
+    cache->counter(context_->requests_total_, workloadTags(i));
+  }
+  Stats::Counter& first = cache->counter(context_->requests_total_, workloadTags(0));
+  EXPECT_EQ(MetricCache::MaxEntries, seriesCreated());
+  // The next series clears the entries, so the first series is resolved again, to the same handle.
+  cache->counter(context_->requests_total_, workloadTags(MetricCache::MaxEntries));
+  EXPECT_EQ(MetricCache::MaxEntries + 1, seriesCreated());
+  EXPECT_EQ(&first, &cache->counter(context_->requests_total_, workloadTags(0)));
+  EXPECT_EQ(MetricCache::MaxEntries + 2, seriesCreated());
+}
+
+TEST_F(MetricCacheTest, OverflowCachedSeparately) {
+  auto cache = createCache(createLimiter(R"EOF(
+cardinality_limits:
+- max_tag_values: 1
+)EOF"));
+  Stats::Counter& within_budget = cache->counter(context_->requests_total_, workloadTags(0));
+  Stats::Counter& overflow = cache->counter(context_->requests_total_, workloadTags(1));
+  EXPECT_NE(&within_budget, &overflow);
+  // The values past the budget resolve to the overflow series.
+  EXPECT_EQ(&overflow, &cache->counter(context_->requests_total_, workloadTags(2)));
+  EXPECT_EQ(2,
+            counterValue("istio_stats.cardinality.istio_requests_total.source_workload.overflow"));
+
+  // The unbounded overflow values do not evict the series within the budget.
+  for (uint64_t i = 3; i < MetricCache::MaxEntries + 3; i++) {
+    cache->counter(context_->requests_total_, workloadTags(i));
+  }
+  const uint64_t series_created = seriesCreated();
+  EXPECT_EQ(&within_budget, &cache->counter(context_->requests_total_, workloadTags(0)));
+  EXPECT_EQ(series_created, seriesCreated());
+}
+
+TEST_F(IstioStatsComponentTest, CardinalityLimiterSeededWithKeptSeries) {
+  CardinalityLimiterSharedPtr limiter = createLimiter(R"EOF(
+cardinality_limits:
+- max_tag_values: 2
+)EOF");
+  const auto limit = [&](uint64_t generation, uint64_t value) {
+    Stats::StatNameTagVector tags = workloadTags(value);
+    limiter->limit(generation, context_->requests_total_, tags);
+    return tags[0].second;
+  };
+  // The kept series are matched by the names of the metrics seen by the limiter.
+  EXPECT_EQ(pool_.add("workload-0"), limit(0, 0));
+
+  Stats::IsolatedStoreImpl kept_store(server_context_.scope().symbolTable());
+  Stats::Scope& kept = *kept_store.rootScope();
+  Stats::Utility::counterFromStatNames(kept, {context_->stat_namespace_, context_->requests_total_},
+                                       workloadTags(1));
+  // The overflow series do not charge the budgets.
+  Stats::Utility::counterFromStatNames(kept, {context_->stat_namespace_, context_->requests_total_},
+                                       {{context_->source_workload_, context_->overflow_}});
+  limiter->seed(1, kept);
+
+  // The kept value is charged to the new budget, and the value of the previous generation is not.
+  EXPECT_EQ(pool_.add("workload-1"), limit(1, 1));
+  EXPECT_EQ(pool_.add("workload-2"), limit(1, 2));
+  EXPECT_EQ(context_->overflow_, limit(1, 0));
+  EXPECT_EQ(context_->overflow_, limit(1, 3));
+}
+
+TEST_F(MetricCacheTest, SampleHistograms) {
+  auto cache = createCache();
+  uint32_t sampled = 0;
+  for (int i = 0; i < 12; i++) {
+    if (cache->sampleHistograms(4)) {
+      sampled++;
+      // One in every sample rate requests.
+      EXPECT_EQ(3, i % 4);
+    }
+  }
+  EXPECT_EQ(3, sampled);
+  // Every request is recorded without sampling.
+  EXPECT_TRUE(cache->sampleHistograms(1));
+  EXPECT_TRUE(cache->sampleHistograms(1));
+}
+
+TEST_F(MetricCacheTest, SampleReport) {
+  auto cache = createCache();
+  uint32_t sampled = 0;
+  for (uint32_t i = 0; i < 2 * SelfTelemetry::SampleRate; i++) {
+    if (cache->sampleReport()) {
+      sampled++;
+    }
+  }
+  EXPECT_EQ(2, sampled);
+}
+
+TEST_F(MetricCacheTest, CounterIncrements) {
+  auto cache = createCache();
+  Stats::Counter& counter = cache->counter(context_->requests_total_, workloadTags(0));
+  // Added directly without a flush interval.
+  cache->addCounter(counter, 2);
+  EXPECT_EQ(2, counter.value());
+}
+
+TEST_F(MetricCacheTest, CounterIncrementsFlushedOnTimer) {
+  auto* flush_timer = new testing::NiceMock<Event::MockTimer>(&server_context_.dispatcher_);
+  auto cache = createCache(nullptr, std::chrono::milliseconds(100));
+  Stats::Counter& counter = cache->counter(context_->requests_total_, workloadTags(0));
+  cache->addCounter(counter, 1);
+  cache->addCounter(counter, 2);
+  cache->addCounter(counter, 0);
+  EXPECT_EQ(0, counter.value());
+  EXPECT_TRUE(flush_timer->enabled());
+
+  // The flush duration is recorded in the server scope, outside of the custom stat namespace, for
+  // the timer flush and the final flush.
+  EXPECT_CALL(server_context_.store_,
+              deliverHistogramToSinks(
+                  Property(&Stats::Metric::name, "istio_stats.counter_flush_duration_us"), _))
+      .Times(2);
+  flush_timer->invokeCallback();
+  EXPECT_EQ(3, counter.value());
+  EXPECT_FALSE(flush_timer->enabled());
+
+  // The pending increments are flushed when the cache is released.
+  cache->addCounter(counter, 4);
+  cache.reset();
+  EXPECT_EQ(7, counter.value());
+}
+
+TEST_F(IstioStatsComponentTest, TagValueTableEvictsLeastRecentlyUsed) {
+  auto stats = std::make_shared<TagValueCacheStatsHolder>(server_context_.scope());
+  TagValueTable table(server_context_.scope().symbolTable(), stats);
+  const TagValueTable::EntrySharedPtr first = table.intern("value-0");
+  const TagValueTable::EntrySharedPtr second = table.intern("value-1");
+  for (size_t i = 2; i < TagValueTable::MaxEntries; i++) {
+    table.intern(absl::StrCat("value-", i));
+  }
+  EXPECT_EQ(TagValueTable::MaxEntries, gaugeValue("istio_stats.tag_value_cache.size"));
+  // The hit makes the first value the most recently used, so the second value is evicted.
+  EXPECT_EQ(first, table.intern("value-0"));
+  table.intern("value-new");
+  EXPECT_EQ(1, counterValue("istio_stats.tag_value_cache.eviction"));
+  EXPECT_EQ(TagValueTable::MaxEntries, gaugeValue("istio_stats.tag_value_cache.size"));
+  EXPECT_EQ(first, table.intern("value-0"));
+
+  // The evicted entry stays valid for its holders, and the value is interned again.
+  const TagValueTable::EntrySharedPtr second_again = table.intern("value-1");
+  EXPECT_NE(second, second_again);
+  EXPECT_EQ("value-1", second->value_);
+  EXPECT_EQ(second->storage_.statName(), second_again->storage_.statName());
+  EXPECT_EQ(2, counterValue("istio_stats.tag_value_cache.eviction"));
+}
+
+TEST_F(IstioStatsComponentTest, TagValueTableStatsPublishedInBatches) {
+  auto stats = std::make_shared<TagValueCacheStatsHolder>(server_context_.scope());
+  {
+    TagValueTable table(server_context_.scope().symbolTable(), stats);
+    for (uint64_t i = 0; i < TagValueTable::StatsBatchSize - 1; i++) {
+      table.intern("value");
+    }
+    EXPECT_EQ(0, counterValue("istio_stats.tag_value_cache.hit"));
+    table.intern("value");
+    EXPECT_EQ(TagValueTable::StatsBatchSize - 1, counterValue("istio_stats.tag_value_cache.hit"));
+    EXPECT_EQ(1, counterValue("istio_stats.tag_value_cache.miss"));
+    table.intern("other");
+  }
+  // The remaining counts and the size are published when the table is released.
+  EXPECT_EQ(2, counterValue("istio_stats.tag_value_cache.miss"));
+  EXPECT_EQ(0, gaugeValue("istio_stats.tag_value_cache.size"));
+}
+
+TEST_F(IstioStatsComponentTest, ExpressionCacheSharesCompiledExpressions) {
+  ExpressionCache cache(server_context_.scope());
+  const CompiledExpressionSharedPtr held = cache.getOrCreate("1 + 1");
+  ASSERT_NE(nullptr, held);
+  EXPECT_EQ(held, cache.getOrCreate("1 + 1"));
+  EXPECT_EQ(1, counterValue("istio_stats.expression_cache.hit"));
+  EXPECT_EQ(1, counterValue("istio_stats.expression_cache.miss"));
+
+  EXPECT_EQ(nullptr, cache.getOrCreate("1 +"));
+  EXPECT_EQ(2, counterValue("istio_stats.expression_cache.miss"));
+
+  // The expression is released with its last holder, and compiled again.
+  cache.getOrCreate("2 + 2");
+  EXPECT_NE(nullptr, cache.getOrCreate("2 + 2"));
+  EXPECT_EQ(1, counterValue("istio_stats.expression_cache.hit"));
+  EXPECT_EQ(4, counterValue("istio_stats.expression_cache.miss"));
+  EXPECT_EQ(2, gaugeValue("istio_stats.expression_cache.size"));
+}
+
+TEST_F(IstioStatsComponentTest, ExpressionCacheSweepsReleasedExpressions) {
+  ExpressionCache cache(server_context_.scope());
+  const CompiledExpressionSharedPtr held = cache.getOrCreate("1 + 1");
+  for (int i = 0; i < 63; i++) {
+    cache.getOrCreate(absl::StrCat(i, " + 2"));
+  }
+  EXPECT_EQ(64, gaugeValue("istio_stats.expression_cache.size"));
+  // The map is swept once it reaches the sweep size, and the held expression is kept.
+  cache.getOrCreate("3 + 3");
+  EXPECT_EQ(2, gaugeValue("istio_stats.expression_cache.size"));
+  EXPECT_EQ(held, cache.getOrCreate("1 + 1"));
+  EXPECT_EQ(1, counterValue("istio_stats.expression_cache.hit"));
+}
+
+TEST_F(IstioStatsComponentTest, CelValueToAmount) {
+  EXPECT_EQ(5, celValueToAmount(CelValue::CreateInt64(5)));
+  // Negative values do not parse as unsigned.
+  EXPECT_EQ(0, celValueToAmount(CelValue::CreateInt64(-5)));
+  EXPECT_EQ(7, celValueToAmount(CelValue::CreateUint64(7)));
+  EXPECT_EQ(42, celValueToAmount(CelValue::CreateStringView("42")));
+  EXPECT_EQ(0, celValueToAmount(CelValue::CreateStringView("4x")));
+  EXPECT_EQ(0, celValueToAmount(CelValue::CreateBool(true)));
+}
+
+TEST_F(IstioStatsComponentTest, CelValueToTag) {
+  // Matches interning the printed value.
+  auto tag = [this](const CelValue& value) {
+    return server_context_.scope().symbolTable().toString(celValueToTag(value, pool_));
+  };
+  EXPECT_EQ("reviews", tag(CelValue::CreateStringView("reviews")));
+  EXPECT_EQ("reviews", tag(CelValue::CreateBytesView("reviews")));
+  EXPECT_EQ("true", tag(CelValue::CreateBool(true)));
+  EXPECT_EQ("false", tag(CelValue::CreateBool(false)));
+  EXPECT_EQ("-3", tag(CelValue::CreateInt64(-3)));
+  EXPECT_EQ("18446744073709551615", tag(CelValue::CreateUint64(UINT64_MAX)));
+  EXPECT_EQ(Filters::Common::Expr::print(CelValue::CreateDouble(1.5)),
+            tag(CelValue::CreateDouble(1.5)));
+}
+
+// The expressions are referenced by ID, so the overrides are set up without compiling them.
+class MetricOverridesTest : public IstioStatsComponentTest {
+protected:
+  using Phase = MetricOverrides::Phase;
+
+  MetricOverrides overrides_{context_, server_context_.scope().symbolTable(), nullptr};
+};
+
+TEST_F(MetricOverridesTest, PhaseExpressions) {
+  overrides_.tag_overrides_[context_->requests_total_][context_->source_app_] = 0;
+  overrides_.tag_overrides_[context_->requests_total_][context_->source_version_] = absl::nullopt;
+  // Dropped metrics do not contribute their expressions.
+  overrides_.tag_overrides_[context_->request_messages_total_][context_->source_app_] = 1;
+  overrides_.drop_.insert(context_->request_messages_total_);
+  overrides_.tag_additions_[context_->tcp_sent_bytes_total_].push_back({pool_.add("tcp_tag"), 2});
+  overrides_.custom_metrics_.try_emplace("custom", pool_.add("custom"), 3,
+                                         MetricOverrides::MetricType::Counter);
+  overrides_.computePhaseExpressions(*context_, {});
+
+  // The gRPC message counters do not depend on any expression, so their evaluation is skipped.
+  EXPECT_THAT(overrides_.phaseExpressions(Phase::GrpcMessages), IsEmpty());
+  EXPECT_THAT(overrides_.phaseExpressions(Phase::HttpStreamEnd), ElementsAre(0, 3));
+  EXPECT_THAT(overrides_.phaseExpressions(Phase::Tcp), ElementsAre(2, 3));
+}
+
+TEST_F(MetricOverridesTest, PhaseExpressionsOfLatencyPhaseMetrics) {
+  const Stats::StatName latency_metric = pool_.add("request_latency_phase");
+  overrides_.tag_additions_[latency_metric].push_back({pool_.add("phase_tag"), 0});
+  overrides_.computePhaseExpressions(*context_, {});
+  EXPECT_THAT(overrides_.phaseExpressions(Phase::HttpStreamEnd), IsEmpty());
+  overrides_.computePhaseExpressions(*context_, {latency_metric});
+  EXPECT_THAT(overrides_.phaseExpressions(Phase::HttpStreamEnd), ElementsAre(0));
+  EXPECT_THAT(overrides_.phaseExpressions(Phase::Tcp), IsEmpty());
+}
+
+TEST_F(MetricOverridesTest, TagPlanPerLayout) {
+  overrides_.tag_overrides_[context_->requests_total_][context_->source_app_] = 0;
+  overrides_.tag_overrides_[context_->requests_total_][context_->response_flags_] = absl::nullopt;
+  const Stats::StatName reporter = pool_.add("destination");
+  const Stats::StatName replaced = pool_.add("replaced");
+  const MetricOverrides::ExprValues expr_values = {{replaced, 0}};
+  const Stats::StatNameTagVector short_tags = {{context_->reporter_, reporter},
+                                               {context_->source_app_, pool_.add("reviews")}};
+  Stats::StatNameTagVector long_tags = short_tags;
+  long_tags.push_back({context_->response_flags_, pool_.add("-")});
+  const Stats::StatNameTagVector expected = {{context_->reporter_, reporter},
+                                             {context_->source_app_, replaced}};
+
+  MetricOverrides::TagPlans plans;
+  Stats::StatNameTagVector out;
+  EXPECT_EQ(&out, overrides_.overrideTags(context_->requests_total_, short_tags, expr_values,
+                                          plans, out));
+  EXPECT_EQ(expected, out);
+  const MetricOverrides::TagPlan* short_plan = &plans[context_->requests_total_][0];
+  // The alternating layouts reuse their plans.
+  for (int i = 0; i < 2; i++) {
+    out.clear();
+    overrides_.overrideTags(context_->requests_total_, long_tags, expr_values, plans, out);
+    EXPECT_EQ(expected, out);
+    out.clear();
+    overrides_.overrideTags(context_->requests_total_, short_tags, expr_values, plans, out);
+    EXPECT_EQ(expected, out);
+  }
+  EXPECT_EQ(2, plans[context_->requests_total_].size());
+  EXPECT_EQ(short_plan, &plans[context_->requests_total_][0]);
+
+  // The plans are bounded if the layouts are not from a fixed set.
+  MetricOverrides::TagPlans unbounded_plans;
+  Stats::StatNameTagVector tags;
+  for (size_t i = 0; i < MetricOverrides::MaxTagLayouts; i++) {
+    tags.push_back({context_->destination_app_, pool_.add(absl::StrCat("app-", i))});
+    overrides_.overrideTags(context_->requests_total_, tags, expr_values, unbounded_plans, out);
+  }
+  EXPECT_EQ(MetricOverrides::MaxTagLayouts, unbounded_plans[context_->requests_total_].size());
+  tags.push_back({context_->destination_app_, pool_.add("app")});
+  overrides_.overrideTags(context_->requests_total_, tags, expr_values, unbounded_plans, out);
+  EXPECT_EQ(1, unbounded_plans[context_->requests_total_].size());
+  EXPECT_EQ(tags, out);
+}
+
+TEST_F(MetricOverridesTest, TagPlanDroppedMetric) {
+  overrides_.drop_.insert(context_->requests_total_);
+  MetricOverrides::TagPlans plans;
+  Stats::StatNameTagVector out;
+  EXPECT_EQ(nullptr, overrides_.overrideTags(context_->requests_total_, workloadTags(0), {},
+                                             plans, out));
+  // The plan of the dropped metric is cached too.
+  EXPECT_EQ(nullptr, overrides_.overrideTags(context_->requests_total_, workloadTags(0), {},
+                                             plans, out));
+  EXPECT_EQ(1, plans[context_->requests_total_].size());
+}
+
+// The time source of the server is simulated, so the report durations are exact.
+class SelfTelemetryTest : public Event::TestUsingSimulatedTime, public IstioStatsComponentTest {};
+
+TEST_F(SelfTelemetryTest, ReportDurationScaledBySampleRate) {
+  SelfTelemetry self_telemetry(server_context_, 0);
+  const MonotonicTime start = self_telemetry.now();
+  simTime().advanceTimeWait(std::chrono::microseconds(3));
+  self_telemetry.recordReport(start);
+  EXPECT_EQ(1, counterValue("istio_stats.self.reports_timed"));
+  // The timed reports stand for the reports that are not sampled.
+  EXPECT_EQ(3000 * SelfTelemetry::SampleRate, counterValue("istio_stats.self.report_duration_ns"));
+}
+
+class CountingReportTarget : public ReportWheel::Target {
+public:
+  void onPeriodicReport() override { reports_++; }
+  uint32_t reports_{0};
+};
+
+TEST(ReportWheelTest, TargetsReportedOncePerRevolution) {
+  testing::NiceMock<Event::MockDispatcher> dispatcher;
+  auto* timer = new testing::NiceMock<Event::MockTimer>(&dispatcher);
+  ReportWheel wheel(dispatcher, std::chrono::milliseconds(1600));
+  CountingReportTarget first;
+  CountingReportTarget second;
+
+  // The timer steps through the slots of the period.
+  EXPECT_CALL(*timer, enableTimer(std::chrono::milliseconds(100), _)).Times(testing::AnyNumber());
+  const ReportWheel::Handle first_handle = wheel.add(first);
+  EXPECT_TRUE(timer->enabled());
+  timer->invokeCallback();
+  const ReportWheel::Handle second_handle = wheel.add(second);
+  // The targets are due a full revolution after they are added.
+  for (uint32_t tick = 2; tick < ReportWheel::NumSlots; tick++) {
+    timer->invokeCallback();
+  }
+  EXPECT_EQ(0, first.reports_);
+  EXPECT_EQ(0, second.reports_);
+  timer->invokeCallback();
+  EXPECT_EQ(1, first.reports_);
+  EXPECT_EQ(0, second.reports_);
+  timer->invokeCallback();
+  EXPECT_EQ(1, first.reports_);
+  EXPECT_EQ(1, second.reports_);
+
+  // The targets remain in their slots for the next revolution.
+  for (uint32_t tick = 0; tick < ReportWheel::NumSlots; tick++) {
+    timer->invokeCallback();
+  }
+  EXPECT_EQ(2, first.reports_);
+  EXPECT_EQ(2, second.reports_);
+
+  // The timer is stopped once the wheel is empty.
+  wheel.remove(first_handle);
+  EXPECT_TRUE(timer->enabled());
+  wheel.remove(second_handle);
+  EXPECT_FALSE(timer->enabled());
+}
+
+} // namespace
+} // namespace IstioStats
+} // namespace HttpFilters
+} // namespace Extensions
+} // namespace Envoy
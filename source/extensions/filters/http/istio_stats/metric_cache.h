@@ -0,0 +1,274 @@
+// Copyright Istio Authors. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#pragma once
+
+#include <chrono>
+#include <string>
+
+#include "absl/container/flat_hash_map.h"
+#include "envoy/event/dispatcher.h"
+#include "envoy/thread_local/thread_local_object.h"
+#include "source/common/common/assert.h"
+#include "source/common/protobuf/protobuf.h"
+#include "source/common/stats/utility.h"
+#include "source/extensions/filters/http/istio_stats/cardinality_limiter.h"
+#include "source/extensions/filters/http/istio_stats/context.h"
+#include "source/extensions/filters/http/istio_stats/metric_overrides.h"
+#include "source/extensions/filters/http/istio_stats/rotating_scope.h"
+#include "source/extensions/filters/http/istio_stats/self_telemetry.h"
+#include "source/extensions/filters/http/istio_stats/tag_value_table.h"
+
+namespace Envoy {
+namespace Extensions {
+namespace HttpFilters {
+namespace IstioStats {
+
+// Per-worker cache of the resolved metric handles keyed by the metric name and the tags. Joining
+// the tags into a stat name and looking it up in the scope is the dominant cost of recording a
+// metric, while the tag sets repeat for steady traffic. The handles are owned by the rotating
+// scope, so the cache is cleared when the scope generation changes.
+//
+// Cardinality limits are applied when a handle is created, so the handles of the series past the
+// budget resolve to the overflow series, and the limiter runs once per distinct series.
+//
+// If the counter flush interval is set, counter increments are also accumulated here and added to
+// the shared counters by a worker timer. The pending scope reference keeps the counters alive
+// across the scope rotation and the removal of the configuration until the next flush.
+class MetricCache : public ThreadLocal::ThreadLocalObject {
+public:
+  // Bounds the memory held by the series that are no longer active.
+  static constexpr size_t MaxEntries = 10000;
+
+  MetricCache(Event::Dispatcher& dispatcher, ContextSharedPtr context,
+              std::chrono::milliseconds flush_interval, Stats::Scope& server_scope,
+              TagValueCacheStatsSharedPtr tag_value_stats, CardinalityLimiterSharedPtr limiter,
+              SelfTelemetrySharedPtr self_telemetry)
+      : context_(context), time_source_(dispatcher.timeSource()), flush_interval_(flush_interval),
+        limiter_(limiter), self_telemetry_(self_telemetry),
+        tag_values_(server_scope.symbolTable(), tag_value_stats) {
+    if (flush_interval_ > std::chrono::milliseconds(0)) {
+      flush_timer_ = dispatcher.createTimer([this] { flush(); });
+      // Proxy-internal, so it stays out of the rotating scope of the Istio metrics.
+      server_scope_ = server_scope.getShared();
+      flush_duration_ = &Stats::Utility::histogramFromStatNames(
+          *server_scope_, {context_->counter_flush_duration_},
+          Stats::Histogram::Unit::Microseconds, {});
+    }
+  }
+  ~MetricCache() override { flush(); }
+
+  // Must be called before the lookups to pick up the active scope.
+  void refresh(RotatingScope& rotating_scope) {
+    const uint64_t generation = rotating_scope.generation();
+    if (scope_ == nullptr || generation != generation_) {
+      // The pending scope reference only covers the counters of a single scope.
+      flush();
+      counters_.clear();
+      histograms_.clear();
+      gauges_.clear();
+      generation_ = generation;
+      rotating_scope_ = &rotating_scope;
+      scope_ = rotating_scope.scope();
+    }
+  }
+
+  Stats::Counter& counter(Stats::StatName metric, const Stats::StatNameTagVector& tags) {
+    return getOrCreate(counters_, metric, tags,
+                       [&](const Stats::StatNameTagVector& limited_tags) -> Stats::Counter& {
+                         return Stats::Utility::counterFromStatNames(
+                             *scope_, {context_->stat_namespace_, metric}, limited_tags);
+                       });
+  }
+
+  TagValueTable& tagValues() { return tag_values_; }
+  PeerTagCache& peerTags() { return peer_tags_; }
+  Protobuf::Arena& arena() { return arena_; }
+  MetricOverrides::TagPlans& tagPlans() { return tag_plans_; }
+
+  // Returns true for one in every sample_rate requests of the worker.
+  bool sampleHistograms(uint32_t sample_rate) {
+    if (++histogram_samples_ < sample_rate) {
+      return false;
+    }
+    histogram_samples_ = 0;
+    return true;
+  }
+  bool sampleReport() {
+    if (++report_samples_ < SelfTelemetry::SampleRate) {
+      return false;
+    }
+    report_samples_ = 0;
+    return true;
+  }
+
+  Stats::Histogram& histogram(Stats::StatName metric, Stats::Histogram::Unit unit,
+                              const Stats::StatNameTagVector& tags) {
+    return getOrCreate(histograms_, metric, tags,
+                       [&](const Stats::StatNameTagVector& limited_tags) -> Stats::Histogram& {
+                         return Stats::Utility::histogramFromStatNames(
+                             *scope_, {context_->stat_namespace_, metric}, unit, limited_tags);
+                       });
+  }
+
+  Stats::Gauge& gauge(Stats::StatName metric, const Stats::StatNameTagVector& tags) {
+    return getOrCreate(gauges_, metric, tags,
+                       [&](const Stats::StatNameTagVector& limited_tags) -> Stats::Gauge& {
+                         return Stats::Utility::gaugeFromStatNames(
+                             *scope_, {context_->stat_namespace_, metric},
+                             Stats::Gauge::ImportMode::Accumulate, limited_tags);
+                       });
+  }
+
+  void addCounter(Stats::Counter& counter, uint64_t amount) {
+    if (flush_timer_ == nullptr) {
+      counter.add(amount);
+      return;
+    }
+    if (amount == 0) {
+      return;
+    }
+    if (pending_.empty()) {
+      pending_scope_ = scope_->getShared();
+      flush_timer_->enableTimer(flush_interval_);
+    }
+    pending_[&counter] += amount;
+  }
+
+private:
+  // Handles keyed by the tags before the cardinality limits. The tags past a budget are cached
+  // separately, so that unbounded tag values neither run the limiter on every request nor evict
+  // the series within the budgets.
+  template <class Metric> struct HandleCache {
+    void clear() {
+      series_.clear();
+      overflow_.clear();
+    }
+    absl::flat_hash_map<std::string, Metric*> series_;
+    absl::flat_hash_map<std::string, Metric*> overflow_;
+  };
+
+  template <class Metric, class Create>
+  Metric& getOrCreate(HandleCache<Metric>& cache, Stats::StatName metric,
+                      const Stats::StatNameTagVector& tags, Create create) {
+    ASSERT(scope_ != nullptr);
+    // The key buffer is reused to avoid an allocation on the lookup.
+    key_.clear();
+    appendKey(metric);
+    for (const auto& [name, value] : tags) {
+      appendKey(name);
+      appendKey(value);
+    }
+    auto it = cache.series_.find(key_);
+    if (it != cache.series_.end()) {
+      return *it->second;
+    }
+    it = cache.overflow_.find(key_);
+    if (it != cache.overflow_.end()) {
+      return *it->second;
+    }
+    const Stats::StatNameTagVector& limited_tags = limit(metric, tags);
+    auto& entries = limited_tags == tags ? cache.series_ : cache.overflow_;
+    if (entries.size() >= MaxEntries) {
+      entries.clear();
+    }
+    Metric& result = create(limited_tags);
+    // The handles are resolved at least once per rotation interval while the series is in use.
+    rotating_scope_->touch(result);
+    // Unused handles are new series, or series not recorded yet.
+    if (self_telemetry_ != nullptr && !result.used()) {
+      self_telemetry_->seriesCreated();
+    }
+    entries.emplace(key_, &result);
+    return result;
+  }
+
+  const Stats::StatNameTagVector& limit(Stats::StatName metric,
+                                        const Stats::StatNameTagVector& tags) {
+    if (limiter_ == nullptr) {
+      return tags;
+    }
+    limited_tags_ = tags;
+    limiter_->limit(generation_, metric, limited_tags_);
+    return limited_tags_;
+  }
+
+  // Stat names are length-prefixed so that the concatenation is unambiguous.
+  void appendKey(Stats::StatName name) {
+    const uint32_t size = name.dataSize();
+    key_.append(reinterpret_cast<const char*>(&size), sizeof(size));
+    if (size > 0) {
+      key_.append(reinterpret_cast<const char*>(name.data()), size);
+    }
+  }
+
+  void flush() {
+    if (pending_.empty()) {
+      return;
+    }
+    const MonotonicTime start = time_source_.monotonicTime();
+    for (const auto& [counter, amount] : pending_) {
+      counter->add(amount);
+    }
+    pending_.clear();
+    flush_duration_->recordValue(
+        std::chrono::duration_cast<std::chrono::microseconds>(time_source_.monotonicTime() - start)
+            .count());
+    pending_scope_.reset();
+  }
+
+  ContextSharedPtr context_;
+  TimeSource& time_source_;
+  const std::chrono::milliseconds flush_interval_;
+  Event::TimerPtr flush_timer_;
+  Stats::ScopeSharedPtr server_scope_;
+  Stats::Histogram* flush_duration_{nullptr};
+
+  uint64_t generation_{0};
+  RotatingScope* rotating_scope_{nullptr};
+  Stats::Scope* scope_{nullptr};
+  std::string key_;
+  HandleCache<Stats::Counter> counters_;
+  HandleCache<Stats::Histogram> histograms_;
+  HandleCache<Stats::Gauge> gauges_;
+
+  CardinalityLimiterSharedPtr limiter_;
+  Stats::StatNameTagVector limited_tags_;
+  SelfTelemetrySharedPtr self_telemetry_;
+
+  Stats::ScopeSharedPtr pending_scope_;
+  absl::flat_hash_map<Stats::Counter*, uint64_t> pending_;
+
+  TagValueTable tag_values_;
+  PeerTagCache peer_tags_{tag_values_};
+  MetricOverrides::TagPlans tag_plans_;
+  uint32_t histogram_samples_{0};
+  uint32_t report_samples_{0};
+
+  // Scratch arena for the expression evaluation. The reset retains the initial block, so the
+  // steady state evaluation does not allocate from the heap.
+  static Protobuf::ArenaOptions arenaOptions(char* block, size_t size) {
+    Protobuf::ArenaOptions options;
+    options.initial_block = block;
+    options.initial_block_size = size;
+    return options;
+  }
+  alignas(8) char arena_block_[8192];
+  Protobuf::Arena arena_{arenaOptions(arena_block_, sizeof(arena_block_))};
+};
+
+} // namespace IstioStats
+} // namespace HttpFilters
+} // namespace Extensions
+} // namespace Envoy
@@ -0,0 +1,266 @@
+// Copyright Istio Authors. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <string>
+#include <vector>
+
+#include "absl/container/flat_hash_map.h"
+#include "absl/container/flat_hash_set.h"
+#include "absl/container/inlined_vector.h"
+#include "absl/types/optional.h"
+#include "envoy/stats/tag.h"
+#include "source/common/common/logger.h"
+#include "source/common/stats/symbol_table.h"
+#include "source/extensions/filters/http/istio_stats/context.h"
+#include "source/extensions/filters/http/istio_stats/expression_cache.h"
+
+namespace Envoy {
+namespace Extensions {
+namespace HttpFilters {
+namespace IstioStats {
+
+// Instructions on dropping, creating, and overriding labels.
+// This is not the "hot path" of the metrics system and thus, fairly
+// unoptimized.
+struct MetricOverrides : public Logger::Loggable<Logger::Id::filter> {
+  MetricOverrides(ContextSharedPtr& context, Stats::SymbolTable& symbol_table,
+                  ExpressionCacheSharedPtr expression_cache)
+      : context_(context), pool_(symbol_table), expression_cache_(expression_cache) {}
+  ContextSharedPtr context_;
+  Stats::StatNameDynamicPool pool_;
+  ExpressionCacheSharedPtr expression_cache_;
+
+  enum class MetricType {
+    Counter,
+    Gauge,
+    Histogram,
+  };
+  struct CustomMetric {
+    Stats::StatName name_;
+    uint32_t expr_;
+    MetricType type_;
+    explicit CustomMetric(Stats::StatName name, uint32_t expr, MetricType type)
+        : name_(name), expr_(expr), type_(type) {}
+  };
+  absl::flat_hash_map<std::string, CustomMetric> custom_metrics_;
+  // Initial transformation: metrics dropped.
+  absl::flat_hash_set<Stats::StatName> drop_;
+  // Second transformation: tags changed.
+  using TagOverrides = absl::flat_hash_map<Stats::StatName, absl::optional<uint32_t>>;
+  absl::flat_hash_map<Stats::StatName, TagOverrides> tag_overrides_;
+  // Third transformation: tags added.
+  using TagAdditions = std::vector<std::pair<Stats::StatName, uint32_t>>;
+  absl::flat_hash_map<Stats::StatName, TagAdditions> tag_additions_;
+
+  // Reporting points of the filter. Each evaluates the expressions before recording its metrics.
+  enum class Phase {
+    // Periodic gRPC message counters.
+    GrpcMessages,
+    // HTTP metrics and the custom metrics at the end of the stream.
+    HttpStreamEnd,
+    // TCP metrics and the custom metrics, evaluated once per connection.
+    Tcp,
+  };
+  static constexpr size_t NumPhases = 3;
+  // Expressions that the metrics of each phase depend on, in the ID order. Dropped metrics do not
+  // contribute, so a phase without dependencies skips the evaluation.
+  std::array<std::vector<uint32_t>, NumPhases> phase_expressions_;
+
+  const std::vector<uint32_t>& phaseExpressions(Phase phase) const {
+    return phase_expressions_[static_cast<size_t>(phase)];
+  }
+
+  // Must be called once all the overrides are added. The latency phase histograms are recorded
+  // with the HTTP metrics.
+  void computePhaseExpressions(const Context& context,
+                               const std::vector<Stats::StatName>& latency_phase_metrics) {
+    computePhaseExpressions(Phase::GrpcMessages,
+                            {context.request_messages_total_, context.response_messages_total_},
+                            false);
+    std::vector<Stats::StatName> http_metrics = {
+        context.requests_total_, context.request_duration_milliseconds_, context.request_bytes_,
+        context.response_bytes_};
+    http_metrics.insert(http_metrics.end(), latency_phase_metrics.begin(),
+                        latency_phase_metrics.end());
+    computePhaseExpressions(Phase::HttpStreamEnd, http_metrics, true);
+    computePhaseExpressions(Phase::Tcp,
+                            {context.tcp_connections_opened_total_,
+                             context.tcp_connections_closed_total_, context.tcp_sent_bytes_total_,
+                             context.tcp_received_bytes_total_},
+                            true);
+  }
+
+  using ExprValues = std::vector<std::pair<Stats::StatName, uint64_t>>;
+
+  // Transformation of the tags of a metric compiled against their layout. The filter builds the
+  // tags of a metric in a fixed order for each reporting point, so the tag lookups are done once
+  // per layout and the steady state transformation is a single pass over the tags.
+  struct TagPlan {
+    enum class Action : uint8_t { Keep, Replace, Drop };
+    struct Step {
+      Stats::StatName name_;
+      Action action_;
+      uint32_t expr_;
+    };
+    bool dropped_{false};
+    // One step per input tag.
+    std::vector<Step> steps_;
+    TagAdditions additions_;
+  };
+  // Plans are compiled by the workers, keyed by the metric name, with a plan per tag layout. The
+  // layouts come from the few reporting points, e.g. with and without a classification tag, so
+  // alternating layouts do not recompile the plans.
+  static constexpr size_t MaxTagLayouts = 8;
+  using TagPlans = absl::flat_hash_map<Stats::StatName, absl::InlinedVector<TagPlan, 2>>;
+
+  TagPlan compileTagPlan(Stats::StatName metric, const Stats::StatNameTagVector& tags) const {
+    TagPlan plan;
+    plan.dropped_ = drop_.contains(metric);
+    plan.steps_.reserve(tags.size());
+    const auto& tag_overrides_it = tag_overrides_.find(metric);
+    for (const auto& [key, _] : tags) {
+      TagPlan::Step step{key, TagPlan::Action::Keep, 0};
+      if (tag_overrides_it != tag_overrides_.end()) {
+        const auto& it = tag_overrides_it->second.find(key);
+        if (it != tag_overrides_it->second.end()) {
+          if (it->second.has_value()) {
+            step.action_ = TagPlan::Action::Replace;
+            step.expr_ = it->second.value();
+          } else {
+            step.action_ = TagPlan::Action::Drop;
+          }
+        }
+      }
+      plan.steps_.push_back(step);
+    }
+    const auto& tag_additions_it = tag_additions_.find(metric);
+    if (tag_additions_it != tag_additions_.end()) {
+      plan.additions_ = tag_additions_it->second;
+    }
+    return plan;
+  }
+
+  // Returns false if the tags do not match the layout of the plan.
+  static bool applyTagPlan(const TagPlan& plan, const Stats::StatNameTagVector& tags,
+                           const ExprValues& expr_values, Stats::StatNameTagVector& out) {
+    if (plan.steps_.size() != tags.size()) {
+      return false;
+    }
+    out.clear();
+    for (size_t i = 0; i < tags.size(); i++) {
+      const auto& step = plan.steps_[i];
+      if (step.name_ != tags[i].first) {
+        return false;
+      }
+      switch (step.action_) {
+      case TagPlan::Action::Keep:
+        out.push_back(tags[i]);
+        break;
+      case TagPlan::Action::Replace:
+        out.push_back({step.name_, expr_values[step.expr_].first});
+        break;
+      case TagPlan::Action::Drop:
+        break;
+      }
+    }
+    for (const auto& [tag, id] : plan.additions_) {
+      out.push_back({tag, expr_values[id].first});
+    }
+    return true;
+  }
+
+  // Writes the transformed tags to the output buffer. Returns nullptr if the metric is dropped.
+  const Stats::StatNameTagVector* overrideTags(Stats::StatName metric,
+                                               const Stats::StatNameTagVector& tags,
+                                               const ExprValues& expr_values, TagPlans& plans,
+                                               Stats::StatNameTagVector& out) const {
+    auto& layouts = plans[metric];
+    for (const auto& plan : layouts) {
+      if (applyTagPlan(plan, tags, expr_values, out)) {
+        return plan.dropped_ ? nullptr : &out;
+      }
+    }
+    // Bounds the plans if the layouts are not from a fixed set.
+    if (layouts.size() >= MaxTagLayouts) {
+      layouts.clear();
+    }
+    const TagPlan& plan = layouts.emplace_back(compileTagPlan(metric, tags));
+    // The plan is compiled from the same tags, so it always applies.
+    applyTagPlan(plan, tags, expr_values, out);
+    return plan.dropped_ ? nullptr : &out;
+  }
+  absl::optional<uint32_t> getOrCreateExpression(const std::string& expr, bool int_expr) {
+    const auto& it = expression_ids_.find(expr);
+    if (it != expression_ids_.end()) {
+      return {it->second};
+    }
+    auto compiled = expression_cache_->getOrCreate(expr);
+    if (compiled == nullptr) {
+      return {};
+    }
+    compiled_exprs_.push_back(std::make_pair(std::move(compiled), int_expr));
+    uint32_t id = compiled_exprs_.size() - 1;
+    expression_ids_.emplace(expr, id);
+    return {id};
+  }
+
+  std::vector<std::pair<CompiledExpressionSharedPtr, bool>> compiled_exprs_;
+  absl::flat_hash_map<std::string, uint32_t> expression_ids_;
+
+  void computePhaseExpressions(Phase phase, const std::vector<Stats::StatName>& standard,
+                               bool custom) {
+    absl::flat_hash_set<uint32_t> ids;
+    for (const auto metric : standard) {
+      if (drop_.contains(metric)) {
+        continue;
+      }
+      const auto& overrides_it = tag_overrides_.find(metric);
+      if (overrides_it != tag_overrides_.end()) {
+        for (const auto& [_, id] : overrides_it->second) {
+          if (id.has_value()) {
+            ids.insert(id.value());
+          }
+        }
+      }
+      addTagAdditions(metric, ids);
+    }
+    if (custom) {
+      for (const auto& [_, metric] : custom_metrics_) {
+        ids.insert(metric.expr_);
+        addTagAdditions(metric.name_, ids);
+      }
+    }
+    auto& out = phase_expressions_[static_cast<size_t>(phase)];
+    out.assign(ids.begin(), ids.end());
+    std::sort(out.begin(), out.end());
+  }
+
+  void addTagAdditions(Stats::StatName metric, absl::flat_hash_set<uint32_t>& ids) const {
+    const auto& additions_it = tag_additions_.find(metric);
+    if (additions_it != tag_additions_.end()) {
+      for (const auto& [_, id] : additions_it->second) {
+        ids.insert(id);
+      }
+    }
+  }
+};
+
+} // namespace IstioStats
+} // namespace HttpFilters
+} // namespace Extensions
+} // namespace Envoy
@@ -0,0 +1,95 @@
+// Copyright Istio Authors. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <iterator>
+#include <list>
+
+#include "envoy/common/pure.h"
+#include "envoy/event/dispatcher.h"
+#include "envoy/thread_local/thread_local_object.h"
+
+namespace Envoy {
+namespace Extensions {
+namespace HttpFilters {
+namespace IstioStats {
+
+// Per-worker wheel of the periodic TCP and gRPC stream reports. The reports of a configuration
+// share the period, so a single timer stepping through the slots replaces a timer per stream and
+// every tick reports a batch of streams. A report is due one revolution after it is scheduled,
+// which is within a tick of the period.
+class ReportWheel : public ThreadLocal::ThreadLocalObject {
+public:
+  static constexpr uint32_t NumSlots = 16;
+
+  class Target {
+  public:
+    virtual ~Target() = default;
+    // Must not remove other targets from the wheel.
+    virtual void onPeriodicReport() PURE;
+  };
+  struct Handle {
+    uint32_t slot_;
+    std::list<Target*>::iterator it_;
+  };
+
+  ReportWheel(Event::Dispatcher& dispatcher, std::chrono::milliseconds period)
+      : tick_(std::max(period / NumSlots, std::chrono::milliseconds(1))),
+        timer_(dispatcher.createTimer([this] { onTick(); })) {}
+
+  Handle add(Target& target) {
+    // The slot that fired last is due after a full revolution.
+    const uint32_t slot = (cursor_ + NumSlots - 1) % NumSlots;
+    slots_[slot].push_back(&target);
+    if (size_++ == 0) {
+      timer_->enableTimer(tick_);
+    }
+    return {slot, std::prev(slots_[slot].end())};
+  }
+
+  void remove(const Handle& handle) {
+    slots_[handle.slot_].erase(handle.it_);
+    if (--size_ == 0) {
+      timer_->disableTimer();
+    }
+  }
+
+private:
+  void onTick() {
+    auto& slot = slots_[cursor_];
+    cursor_ = (cursor_ + 1) % NumSlots;
+    // The targets remain in the slot for the next revolution.
+    for (auto it = slot.begin(); it != slot.end();) {
+      (*it++)->onPeriodicReport();
+    }
+    if (size_ > 0) {
+      timer_->enableTimer(tick_);
+    }
+  }
+
+  const std::chrono::milliseconds tick_;
+  Event::TimerPtr timer_;
+  std::array<std::list<Target*>, NumSlots> slots_;
+  uint32_t cursor_{0};
+  size_t size_{0};
+};
+
+} // namespace IstioStats
+} // namespace HttpFilters
+} // namespace Extensions
+} // namespace Envoy
@@ -0,0 +1,248 @@
+// Copyright Istio Authors. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <functional>
+#include <memory>
+
+#include "absl/container/flat_hash_map.h"
+#include "absl/container/flat_hash_set.h"
+#include "absl/synchronization/mutex.h"
+#include "envoy/event/timer.h"
+#include "envoy/server/factory_context.h"
+#include "envoy/stats/stats_macros.h"
+#include "source/common/common/logger.h"
+
+namespace Envoy {
+namespace Extensions {
+namespace HttpFilters {
+namespace IstioStats {
+
+#define SERIES_EVICTION_STATS(COUNTER, GAUGE, HISTOGRAM)                                           \
+  COUNTER(evicted)                                                                                 \
+  GAUGE(live, NeverImport)                                                                         \
+  HISTOGRAM(eviction_duration_us, Microseconds)                                                    \
+  HISTOGRAM(rotation_duration_us, Microseconds)                                                    \
+  HISTOGRAM(deletion_duration_us, Microseconds)
+
+struct SeriesEvictionStats {
+  SERIES_EVICTION_STATS(GENERATE_COUNTER_STRUCT, GENERATE_GAUGE_STRUCT, GENERATE_HISTOGRAM_STRUCT)
+};
+
+// Self-managed scope with active rotation. Envoy stats scope controls the
+// lifetime of the individual metrics. The scope is created in the server scope
+// and shared by the filter chains with an identical configuration (see
+// ConfigRegistry), so metrics with data derived from the requests can
+// accumulate and grow indefinitely for the lifetime of the server. To limit
+// this growth, this class implements a rotation mechanism, whereas a new scope
+// is created periodically to replace the current scope.
+//
+// The replaced stats scope is deleted gracefully after a minimum of 1s delay
+// for two reasons:
+//
+// 1. Stats flushing is asynchronous and the data may be lost if not flushed
+// before the deletion (see stats_flush_interval).
+//
+// 2. The implementation avoids locking by releasing a raw pointer to workers.
+// When the rotation happens on the main, the raw pointer may still be in-use
+// by workers for a short duration.
+//
+// With the idle eviction, the rotation only drops the series that were not
+// recorded for a number of intervals. The workers report a series as touched
+// when they resolve its handle, which happens at least once per interval for
+// the series in use, since the worker caches are cleared on the rotation. The
+// other series are re-created in the new scope before the swap. The stats
+// allocator shares the stats by name, so the re-created series keep their
+// identity and values.
+class RotatingScope : public Logger::Loggable<Logger::Id::filter> {
+public:
+  RotatingScope(Server::Configuration::ServerFactoryContext& server_context,
+                uint64_t rotate_interval_ms, uint64_t delete_interval_ms, uint32_t idle_intervals)
+      : parent_scope_(server_context.scope()), active_scope_(parent_scope_.createScope("")),
+        raw_scope_(active_scope_.get()), rotate_interval_ms_(rotate_interval_ms),
+        delete_interval_ms_(delete_interval_ms), idle_intervals_(idle_intervals),
+        time_source_(server_context.timeSource()),
+        stats_{SERIES_EVICTION_STATS(POOL_COUNTER_PREFIX(parent_scope_, "istio_stats.series."),
+                                     POOL_GAUGE_PREFIX(parent_scope_, "istio_stats.series."),
+                                     POOL_HISTOGRAM_PREFIX(parent_scope_, "istio_stats.series."))} {
+    if (rotate_interval_ms_ > 0) {
+      ASSERT(delete_interval_ms_ < rotate_interval_ms_);
+      ASSERT(delete_interval_ms_ >= 1000);
+      Event::Dispatcher& dispatcher = server_context.mainThreadDispatcher();
+      rotate_timer_ = dispatcher.createTimer([this] { onRotate(); });
+      delete_timer_ = dispatcher.createTimer([this] { onDelete(); });
+      rotate_timer_->enableTimer(std::chrono::milliseconds(rotate_interval_ms_));
+    }
+  }
+  ~RotatingScope() {
+    if (rotate_timer_) {
+      rotate_timer_->disableTimer();
+      rotate_timer_.reset();
+    }
+    if (delete_timer_) {
+      delete_timer_->disableTimer();
+      delete_timer_.reset();
+    }
+  }
+  Stats::Scope* scope() { return raw_scope_.load(); }
+  // Visits the active scope and the draining scope, if any. Main thread only.
+  void iterateScopes(const std::function<void(Stats::Scope&)>& fn) {
+    fn(*active_scope_);
+    if (draining_scope_) {
+      fn(*draining_scope_);
+    }
+  }
+  // Incremented after each rotation. Read before scope() so that a worker observing a new
+  // generation also observes the new scope.
+  uint64_t generation() const { return generation_.load(std::memory_order_acquire); }
+  // Marks the series as recorded in the current interval. Called by the workers when they resolve
+  // a handle, so at most once per series, worker and interval.
+  void touch(const Stats::Metric& metric) {
+    if (idle_intervals_ == 0) {
+      return;
+    }
+    absl::MutexLock lock(&touch_mutex_);
+    touched_.insert(&metric);
+  }
+  // Called on the rotation with the new scope holding the series kept by the idle eviction, and
+  // the generation of the new scope, before the workers observe it.
+  void setKeptSeriesCallback(std::function<void(Stats::Scope&, uint64_t)> cb) {
+    kept_series_cb_ = std::move(cb);
+  }
+
+private:
+  void onRotate() {
+    ENVOY_LOG(info, "Rotating active Istio stats scope after {}ms.", rotate_interval_ms_);
+    const MonotonicTime start = time_source_.monotonicTime();
+    Stats::ScopeSharedPtr scope = parent_scope_.createScope("");
+    if (idle_intervals_ > 0) {
+      evictIdle(*scope);
+      if (kept_series_cb_) {
+        kept_series_cb_(*scope, generation_.load() + 1);
+      }
+    }
+    draining_scope_ = active_scope_;
+    delete_timer_->enableTimer(std::chrono::milliseconds(delete_interval_ms_));
+    active_scope_ = scope;
+    raw_scope_.store(active_scope_.get());
+    generation_.fetch_add(1, std::memory_order_release);
+    rotate_timer_->enableTimer(std::chrono::milliseconds(rotate_interval_ms_));
+    recordDuration(stats_.rotation_duration_us_, start);
+  }
+  void onDelete() {
+    ENVOY_LOG(info, "Deleting draining Istio stats scope after {}ms.", delete_interval_ms_);
+    const MonotonicTime start = time_source_.monotonicTime();
+    draining_scope_.reset();
+    recordDuration(stats_.deletion_duration_us_, start);
+  }
+  void recordDuration(Stats::Histogram& histogram, MonotonicTime start) {
+    histogram.recordValue(std::chrono::duration_cast<std::chrono::microseconds>(
+                              time_source_.monotonicTime() - start)
+                              .count());
+  }
+
+  // Re-creates the series of the active scope that were recorded recently in the new scope.
+  void evictIdle(Stats::Scope& scope) {
+    const MonotonicTime start = time_source_.monotonicTime();
+    absl::flat_hash_set<const Stats::Metric*> touched;
+    {
+      absl::MutexLock lock(&touch_mutex_);
+      touched.swap(touched_);
+    }
+    // The kept series are referenced by the new scope, so the keys stay valid until the next
+    // rotation, which rebuilds the map.
+    absl::flat_hash_map<const Stats::Metric*, uint32_t> activity;
+    uint64_t evicted = 0;
+    const auto keep = [&](const Stats::Metric& metric) {
+      uint32_t idle_intervals = 0;
+      if (!touched.contains(&metric)) {
+        const auto it = activity_.find(&metric);
+        idle_intervals = (it != activity_.end() ? it->second : 0) + 1;
+        if (idle_intervals >= idle_intervals_) {
+          evicted++;
+          return false;
+        }
+      }
+      activity.emplace(&metric, idle_intervals);
+      return true;
+    };
+    active_scope_->iterate(
+        Stats::IterateFn<Stats::Counter>([&](const Stats::CounterSharedPtr& counter) {
+          if (keep(*counter)) {
+            scope.counterFromStatNameWithTags(counter->tagExtractedStatName(), tags(*counter));
+          }
+          return true;
+        }));
+    active_scope_->iterate(Stats::IterateFn<Stats::Gauge>([&](const Stats::GaugeSharedPtr& gauge) {
+      if (keep(*gauge)) {
+        scope.gaugeFromStatNameWithTags(gauge->tagExtractedStatName(), tags(*gauge),
+                                        gauge->importMode());
+      }
+      return true;
+    }));
+    active_scope_->iterate(
+        Stats::IterateFn<Stats::Histogram>([&](const Stats::HistogramSharedPtr& histogram) {
+          if (keep(*histogram)) {
+            scope.histogramFromStatNameWithTags(histogram->tagExtractedStatName(),
+                                                tags(*histogram), histogram->unit());
+          }
+          return true;
+        }));
+    activity_ = std::move(activity);
+    stats_.evicted_.add(evicted);
+    stats_.live_.set(activity_.size());
+    stats_.eviction_duration_us_.recordValue(
+        std::chrono::duration_cast<std::chrono::microseconds>(time_source_.monotonicTime() -
+                                                              start)
+            .count());
+    ENVOY_LOG(debug, "Evicted {} idle Istio stats series, {} live.", evicted, activity_.size());
+  }
+
+  static Stats::StatNameTagVector tags(const Stats::Metric& metric) {
+    Stats::StatNameTagVector tags;
+    metric.iterateTagStatNames([&tags](Stats::StatName name, Stats::StatName value) {
+      tags.emplace_back(name, value);
+      return true;
+    });
+    return tags;
+  }
+
+  Stats::Scope& parent_scope_;
+  Stats::ScopeSharedPtr active_scope_;
+  std::atomic<Stats::Scope*> raw_scope_;
+  std::atomic<uint64_t> generation_{0};
+  Stats::ScopeSharedPtr draining_scope_{nullptr};
+  const uint64_t rotate_interval_ms_;
+  const uint64_t delete_interval_ms_;
+  const uint32_t idle_intervals_;
+  std::function<void(Stats::Scope&, uint64_t)> kept_series_cb_;
+  TimeSource& time_source_;
+  SeriesEvictionStats stats_;
+  // Number of consecutive rotations without a touch of each kept series.
+  absl::flat_hash_map<const Stats::Metric*, uint32_t> activity_;
+  absl::Mutex touch_mutex_;
+  absl::flat_hash_set<const Stats::Metric*> touched_ ABSL_GUARDED_BY(touch_mutex_);
+  Event::TimerPtr rotate_timer_{nullptr};
+  Event::TimerPtr delete_timer_{nullptr};
+};
+
+using RotatingScopeSharedPtr = std::shared_ptr<RotatingScope>;
+
+} // namespace IstioStats
+} // namespace HttpFilters
+} // namespace Extensions
+} // namespace Envoy
@@ -0,0 +1,92 @@
+// Copyright Istio Authors. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#pragma once
+
+#include <chrono>
+#include <memory>
+#include <vector>
+
+#include "absl/strings/str_cat.h"
+#include "envoy/common/time.h"
+#include "envoy/server/factory_context.h"
+#include "envoy/stats/stats_macros.h"
+#include "source/common/stats/symbol_table.h"
+#include "source/common/stats/utility.h"
+
+namespace Envoy {
+namespace Extensions {
+namespace HttpFilters {
+namespace IstioStats {
+
+#define SELF_TELEMETRY_STATS(COUNTER)                                                              \
+  COUNTER(report_duration_ns)                                                                      \
+  COUNTER(reports_timed)                                                                           \
+  COUNTER(series_created)
+
+struct SelfTelemetryStats {
+  SELF_TELEMETRY_STATS(GENERATE_COUNTER_STRUCT)
+};
+
+// Optional stats of the filter's own overhead. They live in a scope of their own, outside of the
+// custom stat namespace, so that the metric overrides do not apply to them.
+class SelfTelemetry {
+public:
+  // One in SampleRate reports of each worker is timed, and the duration is scaled up to estimate
+  // the total time spent in the reports.
+  static constexpr uint32_t SampleRate = 16;
+
+  SelfTelemetry(Server::Configuration::ServerFactoryContext& server_context, uint64_t config_hash)
+      : time_source_(server_context.timeSource()),
+        scope_(server_context.scope().createScope("istio_stats.self.")),
+        pool_(scope_->symbolTable()), stats_{SELF_TELEMETRY_STATS(POOL_COUNTER(*scope_))},
+        config_(pool_.add(absl::StrCat(absl::Hex(config_hash, absl::kZeroPad16)))) {}
+
+  // Creates the error counters of the expressions, tagged with the configuration hash and the
+  // expression id, since the ids of the configurations overlap. Must be called before the
+  // configuration is used by the workers.
+  void setExpressionCount(size_t count) {
+    const Stats::StatName name = pool_.add("expression_errors");
+    const Stats::StatName config_tag = pool_.add("config");
+    const Stats::StatName id_tag = pool_.add("expression_id");
+    for (size_t id = expression_errors_.size(); id < count; id++) {
+      expression_errors_.push_back(&Stats::Utility::counterFromStatNames(
+          *scope_, {name}, {{config_tag, config_}, {id_tag, pool_.add(absl::StrCat(id))}}));
+    }
+  }
+  void expressionError(uint32_t id) { expression_errors_[id]->inc(); }
+
+  MonotonicTime now() { return time_source_.monotonicTime(); }
+  void recordReport(MonotonicTime start) {
+    stats_.report_duration_ns_.add(
+        std::chrono::duration_cast<std::chrono::nanoseconds>(now() - start).count() * SampleRate);
+    stats_.reports_timed_.inc();
+  }
+  void seriesCreated() { stats_.series_created_.inc(); }
+
+private:
+  TimeSource& time_source_;
+  Stats::ScopeSharedPtr scope_;
+  Stats::StatNamePool pool_;
+  SelfTelemetryStats stats_;
+  const Stats::StatName config_;
+  std::vector<Stats::Counter*> expression_errors_;
+};
+
+using SelfTelemetrySharedPtr = std::shared_ptr<SelfTelemetry>;
+
+} // namespace IstioStats
+} // namespace HttpFilters
+} // namespace Extensions
+} // namespace Envoy
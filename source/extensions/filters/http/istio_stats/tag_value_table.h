@@ -0,0 +1,241 @@
+// Copyright Istio Authors. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#pragma once
+
+#include <algorithm>
+#include <list>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "absl/container/flat_hash_map.h"
+#include "absl/container/inlined_vector.h"
+#include "absl/hash/hash.h"
+#include "envoy/stats/scope.h"
+#include "envoy/stats/stats_macros.h"
+#include "extensions/common/metadata_object.h"
+#include "source/common/stats/symbol_table.h"
+
+namespace Envoy {
+namespace Extensions {
+namespace HttpFilters {
+namespace IstioStats {
+
+#define TAG_VALUE_CACHE_STATS(COUNTER, GAUGE)                                                      \
+  COUNTER(hit)                                                                                     \
+  COUNTER(miss)                                                                                    \
+  COUNTER(eviction)                                                                                \
+  GAUGE(size, NeverImport)
+
+struct TagValueCacheStats {
+  TAG_VALUE_CACHE_STATS(GENERATE_COUNTER_STRUCT, GENERATE_GAUGE_STRUCT)
+};
+
+// The stats outlive the listener scope if a worker table is released after the configuration.
+struct TagValueCacheStatsHolder {
+  TagValueCacheStatsHolder(Stats::Scope& scope)
+      : scope_(scope.getShared()),
+        stats_{TAG_VALUE_CACHE_STATS(POOL_COUNTER_PREFIX(*scope_, "istio_stats.tag_value_cache."),
+                                     POOL_GAUGE_PREFIX(*scope_, "istio_stats.tag_value_cache."))} {}
+  Stats::ScopeSharedPtr scope_;
+  TagValueCacheStats stats_;
+};
+
+using TagValueCacheStatsSharedPtr = std::shared_ptr<TagValueCacheStatsHolder>;
+
+// Per-worker bounded LRU table of the interned tag values. Peer workload names, principals, hosts,
+// response codes and flags come from a small working set, so interning them once per worker
+// replaces the allocations of a per-stream dynamic pool. Entries are reference counted: the
+// streams hold on to the values they use, so an evicted value stays valid until they complete.
+class TagValueTable {
+public:
+  // Bounds the memory held by the values that are no longer in use.
+  static constexpr size_t MaxEntries = 4096;
+  // Hit and miss counts are published in batches to keep the shared counters off the hot path.
+  static constexpr uint64_t StatsBatchSize = 1024;
+
+  struct Entry {
+    Entry(absl::string_view value, Stats::SymbolTable& symbol_table)
+        : value_(value), storage_(value_, symbol_table) {}
+    const std::string value_;
+    Stats::StatNameDynamicStorage storage_;
+  };
+  using EntrySharedPtr = std::shared_ptr<const Entry>;
+
+  TagValueTable(Stats::SymbolTable& symbol_table, TagValueCacheStatsSharedPtr stats)
+      : symbol_table_(symbol_table), stats_(stats) {}
+  ~TagValueTable() {
+    publishStats();
+    stats_->stats_.size_.sub(lru_.size());
+  }
+
+  EntrySharedPtr intern(absl::string_view value) {
+    const auto it = index_.find(value);
+    if (it != index_.end()) {
+      hits_++;
+      lru_.splice(lru_.begin(), lru_, it->second);
+      maybePublishStats();
+      return *it->second;
+    }
+    misses_++;
+    maybePublishStats();
+    if (lru_.size() >= MaxEntries) {
+      index_.erase(lru_.back()->value_);
+      lru_.pop_back();
+      stats_->stats_.eviction_.inc();
+      stats_->stats_.size_.dec();
+    }
+    lru_.push_front(std::make_shared<const Entry>(value, symbol_table_));
+    index_.emplace(lru_.front()->value_, lru_.begin());
+    stats_->stats_.size_.inc();
+    return lru_.front();
+  }
+
+private:
+  void maybePublishStats() {
+    if (hits_ + misses_ >= StatsBatchSize) {
+      publishStats();
+    }
+  }
+  void publishStats() {
+    stats_->stats_.hit_.add(hits_);
+    stats_->stats_.miss_.add(misses_);
+    hits_ = 0;
+    misses_ = 0;
+  }
+
+  Stats::SymbolTable& symbol_table_;
+  TagValueCacheStatsSharedPtr stats_;
+  std::list<EntrySharedPtr> lru_;
+  // Keys point into the entries owned by the LRU list.
+  absl::flat_hash_map<absl::string_view, std::list<EntrySharedPtr>::iterator> index_;
+  uint64_t hits_{0};
+  uint64_t misses_{0};
+};
+
+// Drop-in replacement for the per-stream dynamic pool that interns the values in the worker
+// table. The returned stat names are valid for the lifetime of the pool.
+class TagValuePool {
+public:
+  explicit TagValuePool(TagValueTable& table) : table_(table) {}
+  Stats::StatName add(absl::string_view value) {
+    values_.push_back(table_.intern(value));
+    return values_.back()->storage_.statName();
+  }
+
+private:
+  TagValueTable& table_;
+  absl::InlinedVector<TagValueTable::EntrySharedPtr, 24> values_;
+};
+
+// Inputs of the peer-derived tags. The peer objects are borrowed from the filter state.
+struct PeerTagInputs {
+  const Istio::Common::WorkloadMetadataObject* peer_;
+  // Only set for the gateway reporter.
+  const Istio::Common::WorkloadMetadataObject* endpoint_peer_;
+  absl::string_view peer_namespace_;
+  absl::string_view peer_san_;
+  absl::string_view local_san_;
+  absl::string_view service_host_;
+  absl::string_view service_host_name_;
+  absl::string_view service_namespace_;
+};
+
+// Prebuilt segment of the peer-derived tags. The pool keeps the tag values alive for the streams
+// still using the segment after it is evicted.
+struct PeerTagBlock {
+  explicit PeerTagBlock(TagValueTable& table) : pool_(table) {}
+  std::vector<std::string> key_;
+  TagValuePool pool_;
+  Stats::StatNameTagVector tags_;
+};
+
+using PeerTagBlockSharedPtr = std::shared_ptr<const PeerTagBlock>;
+
+// Per-worker LRU cache of the peer tag segments. A segment only depends on the reporter, which is
+// fixed for the configuration, and on the inputs, so the streams between the same peer and the
+// same destination service reuse it instead of building about 17 tags each. Past the bound, the
+// least recently used segment is evicted, so a proxy with more live peers keeps the hot ones.
+class PeerTagCache {
+public:
+  static constexpr size_t MaxEntries = 1024;
+
+  explicit PeerTagCache(TagValueTable& table) : table_(table) {}
+
+  template <class Build>
+  PeerTagBlockSharedPtr getOrCreate(const PeerTagInputs& inputs, Build build) {
+    Key key;
+    appendKey(key, inputs.peer_);
+    appendKey(key, inputs.endpoint_peer_);
+    key.push_back(inputs.peer_namespace_);
+    key.push_back(inputs.peer_san_);
+    key.push_back(inputs.local_san_);
+    key.push_back(inputs.service_host_);
+    key.push_back(inputs.service_host_name_);
+    key.push_back(inputs.service_namespace_);
+    const size_t hash = absl::Hash<Key>{}(key);
+    const auto it = index_.find(hash);
+    if (it != index_.end()) {
+      const PeerTagBlock& cached = *it->second->second;
+      if (std::equal(key.begin(), key.end(), cached.key_.begin(), cached.key_.end())) {
+        lru_.splice(lru_.begin(), lru_, it->second);
+        return it->second->second;
+      }
+      // A hash collision replaces the previous segment.
+      lru_.erase(it->second);
+      index_.erase(it);
+    } else if (lru_.size() >= MaxEntries) {
+      index_.erase(lru_.back().first);
+      lru_.pop_back();
+    }
+    auto block = std::make_shared<PeerTagBlock>(table_);
+    block->key_.assign(key.begin(), key.end());
+    build(block->tags_, block->pool_);
+    lru_.emplace_front(hash, block);
+    index_.emplace(hash, lru_.begin());
+    return block;
+  }
+
+private:
+  using Key = absl::InlinedVector<absl::string_view, 24>;
+
+  // Appends a fixed number of fields so that the key layout is unambiguous.
+  static void appendKey(Key& key, const Istio::Common::WorkloadMetadataObject* peer) {
+    if (peer == nullptr) {
+      key.push_back("0");
+      key.insert(key.end(), 8, absl::string_view());
+      return;
+    }
+    key.push_back("1");
+    key.push_back(peer->workload_name_);
+    key.push_back(peer->namespace_name_);
+    key.push_back(peer->canonical_name_);
+    key.push_back(peer->canonical_revision_);
+    key.push_back(peer->app_name_);
+    key.push_back(peer->app_version_);
+    key.push_back(peer->cluster_name_);
+    key.push_back(peer->identity_);
+  }
+
+  TagValueTable& table_;
+  std::list<std::pair<size_t, PeerTagBlockSharedPtr>> lru_;
+  absl::flat_hash_map<size_t, std::list<std::pair<size_t, PeerTagBlockSharedPtr>>::iterator>
+      index_;
+};
+
+} // namespace IstioStats
+} // namespace HttpFilters
+} // namespace Extensions
+} // namespace Envoy
@@ -15,6 +15,7 @@
 #include "source/extensions/filters/http/peer_metadata/filter.h"
 
 #include "envoy/registry/registry.h"
+#include "envoy/router/string_accessor.h"
 #include "envoy/server/factory_context.h"
 #include "source/common/common/hash.h"
 #include "source/common/common/base64.h"
@@ -22,6 +23,7 @@
 #include "source/common/http/utility.h"
 #include "source/common/network/utility.h"
 
+#include "extensions/common/cluster_metadata.h"
 #include "extensions/common/metadata_object.h"
 
 namespace Envoy {
@@ -29,26 +31,39 @@ namespace Extensions {
 namespace HttpFilters {
 namespace PeerMetadata {
 
+namespace {
+PeerInfoSharedPtr toShared(std::optional<PeerInfo>&& peer) {
+  return peer ? std::make_shared<PeerInfo>(std::move(*peer)) : nullptr;
+}
+} // namespace
+
 class XDSMethod : public DiscoveryMethod {
 public:
   XDSMethod(bool downstream, Server::Configuration::ServerFactoryContext& factory_context)
       : downstream_(downstream),
         metadata_provider_(Extensions::Common::WorkloadDiscovery::GetProvider(factory_context)) {}
-  absl::optional<PeerInfo> derivePeerInfo(const StreamInfo::StreamInfo&, Http::HeaderMap&,
-                                          Context&) const override;
+  PeerInfoSharedPtr derivePeerInfo(StreamInfo::StreamInfo&, Http::HeaderMap&,
+                                   Context&) const override;
 
 private:
   const bool downstream_;
   Extensions::Common::WorkloadDiscovery::WorkloadMetadataProviderSharedPtr metadata_provider_;
 };
 
-absl::optional<PeerInfo> XDSMethod::derivePeerInfo(const StreamInfo::StreamInfo& info,
-                                                   Http::HeaderMap&, Context&) const {
+PeerInfoSharedPtr XDSMethod::derivePeerInfo(StreamInfo::StreamInfo& info, Http::HeaderMap&,
+                                            Context&) const {
   if (!metadata_provider_) {
     return {};
   }
   Network::Address::InstanceConstSharedPtr peer_address;
   if (downstream_) {
+    // Reuse the peer resolved by the listener filter when the connection was accepted.
+    // The object is shared by the streams of the connection instead of copied per stream.
+    auto connection_peer = std::dynamic_pointer_cast<PeerInfo>(
+        info.filterState()->getDataSharedMutableGeneric(Istio::Common::ConnectionPeer));
+    if (connection_peer) {
+      return connection_peer;
+    }
     peer_address = info.downstreamAddressProvider().remoteAddress();
   } else {
     if (info.upstreamInfo().has_value()) {
@@ -78,7 +93,81 @@ absl::optional<PeerInfo> XDSMethod::derivePeerInfo(const StreamInfo::StreamInfo&
       }
     }
   }
-  return metadata_provider_->GetMetadata(peer_address);
+  return toShared(metadata_provider_->GetMetadata(peer_address));
+}
+
+class XDSIdentityMethod : public DiscoveryMethod {
+public:
+  XDSIdentityMethod(bool downstream, Server::Configuration::ServerFactoryContext& factory_context)
+      : downstream_(downstream),
+        metadata_provider_(Extensions::Common::WorkloadDiscovery::GetProvider(factory_context)) {}
+  PeerInfoSharedPtr derivePeerInfo(StreamInfo::StreamInfo&, Http::HeaderMap&,
+                                   Context&) const override;
+
+private:
+  const bool downstream_;
+  Extensions::Common::WorkloadDiscovery::WorkloadMetadataProviderSharedPtr metadata_provider_;
+};
+
+PeerInfoSharedPtr XDSIdentityMethod::derivePeerInfo(StreamInfo::StreamInfo& info, Http::HeaderMap&,
+                                                    Context&) const {
+  if (!metadata_provider_) {
+    return {};
+  }
+  absl::string_view identity;
+  Ssl::ConnectionInfoConstSharedPtr ssl_info;
+  if (downstream_) {
+    const auto* peer_principal =
+        info.filterState().getDataReadOnly<Router::StringAccessor>("io.istio.peer_principal");
+    if (peer_principal) {
+      identity = peer_principal->asString();
+    }
+    ssl_info = info.downstreamAddressProvider().sslConnection();
+  } else if (info.upstreamInfo().has_value()) {
+    ssl_info = info.upstreamInfo().value().get().upstreamSslConnection();
+  }
+  // The SANs are parsed once and cached by the TLS connection.
+  if (identity.empty() && ssl_info && !ssl_info->uriSanPeerCertificate().empty()) {
+    identity = ssl_info->uriSanPeerCertificate()[0];
+  }
+  if (identity.empty()) {
+    return {};
+  }
+  return toShared(metadata_provider_->GetMetadataByIdentity(identity));
+}
+
+class XDSUidMethod : public DiscoveryMethod {
+public:
+  XDSUidMethod(bool downstream, Server::Configuration::ServerFactoryContext& factory_context)
+      : downstream_(downstream),
+        metadata_provider_(Extensions::Common::WorkloadDiscovery::GetProvider(factory_context)) {}
+  PeerInfoSharedPtr derivePeerInfo(StreamInfo::StreamInfo&, Http::HeaderMap&,
+                                   Context&) const override;
+  void remove(Http::HeaderMap&) const override;
+
+private:
+  const bool downstream_;
+  Extensions::Common::WorkloadDiscovery::WorkloadMetadataProviderSharedPtr metadata_provider_;
+};
+
+PeerInfoSharedPtr XDSUidMethod::derivePeerInfo(StreamInfo::StreamInfo&, Http::HeaderMap& headers,
+                                               Context& ctx) const {
+  const auto peer_uid_header = headers.get(Headers::get().ExchangeMetadataHeaderUid);
+  if (peer_uid_header.empty()) {
+    return {};
+  }
+  if (downstream_) {
+    ctx.request_peer_uid_received_ = true;
+  }
+  if (!metadata_provider_) {
+    return {};
+  }
+  return toShared(
+      metadata_provider_->GetMetadataByUid(peer_uid_header[0]->value().getStringView()));
+}
+
+void XDSUidMethod::remove(Http::HeaderMap& headers) const {
+  headers.remove(Headers::get().ExchangeMetadataHeaderUid);
 }
 
 MXMethod::MXMethod(bool downstream, Server::Configuration::ServerFactoryContext& factory_context)
@@ -86,8 +175,8 @@ MXMethod::MXMethod(bool downstream, Server::Configuration::ServerFactoryContext&
   tls_.set([](Event::Dispatcher&) { return std::make_shared<MXCache>(); });
 }
 
-absl::optional<PeerInfo> MXMethod::derivePeerInfo(const StreamInfo::StreamInfo&,
-                                                  Http::HeaderMap& headers, Context& ctx) const {
+PeerInfoSharedPtr MXMethod::derivePeerInfo(StreamInfo::StreamInfo&, Http::HeaderMap& headers,
+                                           Context& ctx) const {
   const auto peer_id_header = headers.get(Headers::get().ExchangeMetadataHeaderId);
   if (downstream_) {
     ctx.request_peer_id_received_ = !peer_id_header.empty();
@@ -111,7 +200,7 @@ void MXMethod::remove(Http::HeaderMap& headers) const {
   headers.remove(Headers::get().ExchangeMetadataHeader);
 }
 
-absl::optional<PeerInfo> MXMethod::lookup(absl::string_view id, absl::string_view value) const {
+PeerInfoSharedPtr MXMethod::lookup(absl::string_view id, absl::string_view value) const {
   // This code is copied from:
   // https://github.com/istio/proxy/blob/release-1.18/extensions/metadata_exchange/plugin.cc#L116
   auto& cache = tls_->cache_;
@@ -126,23 +215,27 @@ absl::optional<PeerInfo> MXMethod::lookup(absl::string_view id, absl::string_vie
   if (!metadata.ParseFromString(bytes)) {
     return {};
   }
-  const auto out = Istio::Common::convertStructToWorkloadMetadata(metadata);
+  PeerInfoSharedPtr out = Istio::Common::convertStructToWorkloadMetadata(metadata);
   if (max_peer_cache_size_ > 0 && !id.empty()) {
     // do not let the cache grow beyond max cache size.
     if (static_cast<uint32_t>(cache.size()) > max_peer_cache_size_) {
       cache.erase(cache.begin(), std::next(cache.begin(), max_peer_cache_size_ / 4));
     }
-    cache.emplace(id, *out);
+    cache.emplace(id, out);
   }
-  return *out;
+  return out;
 }
 
 MXPropagationMethod::MXPropagationMethod(
     bool downstream, Server::Configuration::ServerFactoryContext& factory_context,
     const io::istio::http::peer_metadata::Config_IstioHeaders& istio_headers)
+    : MXPropagationMethod(downstream, factory_context, istio_headers.skip_external_clusters()) {}
+
+MXPropagationMethod::MXPropagationMethod(
+    bool downstream, Server::Configuration::ServerFactoryContext& factory_context,
+    bool skip_external_clusters)
     : downstream_(downstream), id_(factory_context.localInfo().node().id()),
-      value_(computeValue(factory_context)),
-      skip_external_clusters_(istio_headers.skip_external_clusters()) {}
+      value_(computeValue(factory_context)), skip_external_clusters_(skip_external_clusters) {}
 
 std::string MXPropagationMethod::computeValue(
     Server::Configuration::ServerFactoryContext& factory_context) const {
@@ -168,6 +261,49 @@ void MXPropagationMethod::inject(const StreamInfo::StreamInfo& info, Http::Heade
   }
 }
 
+namespace {
+// Follows the workload UID convention for pods in the workload metadata xDS.
+std::string computeUid(Server::Configuration::ServerFactoryContext& factory_context) {
+  const auto& metadata = factory_context.localInfo().node().metadata().fields();
+  const auto cluster_it = metadata.find(Istio::Common::ClusterMetadataField);
+  const auto namespace_it = metadata.find(Istio::Common::NamespaceMetadataField);
+  const auto name_it = metadata.find(Istio::Common::InstanceMetadataField);
+  if (cluster_it == metadata.end() || namespace_it == metadata.end() || name_it == metadata.end()) {
+    return "";
+  }
+  return absl::StrCat(cluster_it->second.string_value(), "//Pod/",
+                      namespace_it->second.string_value(), "/", name_it->second.string_value());
+}
+} // namespace
+
+MXUidPropagationMethod::MXUidPropagationMethod(
+    bool downstream, Server::Configuration::ServerFactoryContext& factory_context,
+    const io::istio::http::peer_metadata::Config_WorkloadUid& workload_uid)
+    : MXPropagationMethod(downstream, factory_context, workload_uid.skip_external_clusters()),
+      uid_(computeUid(factory_context)),
+      metadata_provider_(Extensions::Common::WorkloadDiscovery::GetProvider(factory_context)) {}
+
+void MXUidPropagationMethod::inject(const StreamInfo::StreamInfo& info, Http::HeaderMap& headers,
+                                    Context& ctx) const {
+  if (downstream_ && !ctx.request_peer_uid_received_) {
+    // Respond in the same format as the request.
+    MXPropagationMethod::inject(info, headers, ctx);
+    return;
+  }
+  if (skip_external_clusters_) {
+    if (skipMXHeaders(info)) {
+      return;
+    }
+  }
+  if (!uid_.empty() && metadata_provider_ && metadata_provider_->HasUid(uid_)) {
+    headers.setReference(Headers::get().ExchangeMetadataHeaderUid, uid_);
+    return;
+  }
+  // The peer cannot resolve an unknown UID, fall back to the full metadata.
+  headers.setReference(Headers::get().ExchangeMetadataHeaderId, id_);
+  headers.setReference(Headers::get().ExchangeMetadataHeader, value_);
+}
+
 FilterConfig::FilterConfig(const io::istio::http::peer_metadata::Config& config,
                            Server::Configuration::FactoryContext& factory_context)
     : shared_with_upstream_(config.shared_with_upstream()),
@@ -198,6 +334,16 @@ std::vector<DiscoveryMethodPtr> FilterConfig::buildDiscoveryMethods(
       methods.push_back(
           std::make_unique<MXMethod>(downstream, factory_context.serverFactoryContext()));
       break;
+    case io::istio::http::peer_metadata::Config::DiscoveryMethod::MethodSpecifierCase::
+        kWorkloadIdentityDiscovery:
+      methods.push_back(
+          std::make_unique<XDSIdentityMethod>(downstream, factory_context.serverFactoryContext()));
+      break;
+    case io::istio::http::peer_metadata::Config::DiscoveryMethod::MethodSpecifierCase::
+        kWorkloadUid:
+      methods.push_back(
+          std::make_unique<XDSUidMethod>(downstream, factory_context.serverFactoryContext()));
+      break;
     default:
       break;
     }
@@ -218,6 +364,11 @@ std::vector<PropagationMethodPtr> FilterConfig::buildPropagationMethods(
       methods.push_back(std::make_unique<MXPropagationMethod>(
           downstream, factory_context.serverFactoryContext(), method.istio_headers()));
       break;
+    case io::istio::http::peer_metadata::Config::PropagationMethod::MethodSpecifierCase::
+        kWorkloadUid:
+      methods.push_back(std::make_unique<MXUidPropagationMethod>(
+          downstream, factory_context.serverFactoryContext(), method.workload_uid()));
+      break;
     default:
       break;
     }
@@ -240,7 +391,7 @@ void FilterConfig::discover(StreamInfo::StreamInfo& info, bool downstream, Http:
   for (const auto& method : downstream ? downstream_discovery_ : upstream_discovery_) {
     const auto result = method->derivePeerInfo(info, headers, ctx);
     if (result) {
-      setFilterState(info, downstream, *result);
+      setFilterState(info, downstream, result);
       break;
     }
   }
@@ -264,13 +415,13 @@ void FilterConfig::injectUpstream(const StreamInfo::StreamInfo& info,
 }
 
 void FilterConfig::setFilterState(StreamInfo::StreamInfo& info, bool downstream,
-                                  const PeerInfo& value) const {
+                                  PeerInfoSharedPtr value) const {
   const absl::string_view key =
       downstream ? Istio::Common::DownstreamPeer : Istio::Common::UpstreamPeer;
   if (!info.filterState()->hasDataWithName(key)) {
-    info.filterState()->setData(
-        key, std::make_shared<PeerInfo>(value), StreamInfo::FilterState::StateType::Mutable,
-        StreamInfo::FilterState::LifeSpan::FilterChain, sharedWithUpstream());
+    info.filterState()->setData(key, std::move(value), StreamInfo::FilterState::StateType::Mutable,
+                                StreamInfo::FilterState::LifeSpan::FilterChain,
+                                sharedWithUpstream());
   } else {
     ENVOY_LOG(debug, "Duplicate peer metadata, skipping");
   }
@@ -289,14 +440,8 @@ bool MXPropagationMethod::skipMXHeaders(const StreamInfo::StreamInfo& info) cons
     if (cluster_name == "PassthroughCluster") {
       return true;
     }
-    const auto& filter_metadata = cluster_info.value()->metadata().filter_metadata();
-    const auto& it = filter_metadata.find("istio");
-    if (it != filter_metadata.end()) {
-      const auto& skip_mx = it->second.fields().find("external");
-      if (skip_mx != it->second.fields().end()) {
-        return skip_mx->second.bool_value();
-      }
-    }
+    const auto* digest = Istio::Common::ClusterMetadataDigest::get(*cluster_info.value());
+    return digest != nullptr && digest->external_;
   }
   return false;
 }
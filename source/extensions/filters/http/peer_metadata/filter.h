@@ -28,23 +28,27 @@ namespace PeerMetadata {
 struct HeaderValues {
   const Http::LowerCaseString ExchangeMetadataHeader{"x-envoy-peer-metadata"};
   const Http::LowerCaseString ExchangeMetadataHeaderId{"x-envoy-peer-metadata-id"};
+  const Http::LowerCaseString ExchangeMetadataHeaderUid{"x-envoy-peer-metadata-uid"};
 };
 
 using Headers = ConstSingleton<HeaderValues>;
 
 using PeerInfo = Istio::Common::WorkloadMetadataObject;
+using PeerInfoSharedPtr = std::shared_ptr<PeerInfo>;
 
 struct Context {
   bool request_peer_id_received_{false};
   bool request_peer_received_{false};
+  bool request_peer_uid_received_{false};
 };
 
 // Base class for the discovery methods. First derivation wins but all methods perform removal.
 class DiscoveryMethod {
 public:
   virtual ~DiscoveryMethod() = default;
-  virtual absl::optional<PeerInfo> derivePeerInfo(const StreamInfo::StreamInfo&, Http::HeaderMap&,
-                                                  Context&) const PURE;
+  // Returns nullptr if the peer is not discovered.
+  virtual PeerInfoSharedPtr derivePeerInfo(StreamInfo::StreamInfo&, Http::HeaderMap&,
+                                           Context&) const PURE;
   virtual void remove(Http::HeaderMap&) const {}
 };
 
@@ -53,15 +57,15 @@ using DiscoveryMethodPtr = std::unique_ptr<DiscoveryMethod>;
 class MXMethod : public DiscoveryMethod {
 public:
   MXMethod(bool downstream, Server::Configuration::ServerFactoryContext& factory_context);
-  absl::optional<PeerInfo> derivePeerInfo(const StreamInfo::StreamInfo&, Http::HeaderMap&,
-                                          Context&) const override;
+  PeerInfoSharedPtr derivePeerInfo(StreamInfo::StreamInfo&, Http::HeaderMap&,
+                                   Context&) const override;
   void remove(Http::HeaderMap&) const override;
 
 private:
-  absl::optional<PeerInfo> lookup(absl::string_view id, absl::string_view value) const;
+  PeerInfoSharedPtr lookup(absl::string_view id, absl::string_view value) const;
   const bool downstream_;
   struct MXCache : public ThreadLocal::ThreadLocalObject {
-    absl::flat_hash_map<std::string, PeerInfo> cache_;
+    absl::flat_hash_map<std::string, PeerInfoSharedPtr> cache_;
   };
   mutable ThreadLocal::TypedSlot<MXCache> tls_;
   const int64_t max_peer_cache_size_{500};
@@ -82,7 +86,9 @@ public:
                       const io::istio::http::peer_metadata::Config_IstioHeaders&);
   void inject(const StreamInfo::StreamInfo&, Http::HeaderMap&, Context&) const override;
 
-private:
+protected:
+  MXPropagationMethod(bool downstream, Server::Configuration::ServerFactoryContext& factory_context,
+                      bool skip_external_clusters);
   const bool downstream_;
   std::string computeValue(Server::Configuration::ServerFactoryContext&) const;
   const std::string id_;
@@ -91,6 +97,20 @@ private:
   bool skipMXHeaders(const StreamInfo::StreamInfo&) const;
 };
 
+// Sends the workload UID instead of the full metadata if the local workload is known to the
+// workload metadata xDS.
+class MXUidPropagationMethod : public MXPropagationMethod {
+public:
+  MXUidPropagationMethod(bool downstream,
+                         Server::Configuration::ServerFactoryContext& factory_context,
+                         const io::istio::http::peer_metadata::Config_WorkloadUid&);
+  void inject(const StreamInfo::StreamInfo&, Http::HeaderMap&, Context&) const override;
+
+private:
+  const std::string uid_;
+  Extensions::Common::WorkloadDiscovery::WorkloadMetadataProviderSharedPtr metadata_provider_;
+};
+
 class FilterConfig : public Logger::Loggable<Logger::Id::filter> {
 public:
   FilterConfig(const io::istio::http::peer_metadata::Config&,
@@ -113,7 +133,7 @@ private:
                : StreamInfo::StreamSharingMayImpactPooling::None;
   }
   void discover(StreamInfo::StreamInfo&, bool downstream, Http::HeaderMap&, Context&) const;
-  void setFilterState(StreamInfo::StreamInfo&, bool downstream, const PeerInfo& value) const;
+  void setFilterState(StreamInfo::StreamInfo&, bool downstream, PeerInfoSharedPtr value) const;
   const bool shared_with_upstream_;
   const std::vector<DiscoveryMethodPtr> downstream_discovery_;
   const std::vector<DiscoveryMethodPtr> upstream_discovery_;
@@ -14,10 +14,13 @@
 
 #include "source/extensions/filters/http/peer_metadata/filter.h"
 
+#include "source/common/config/metadata.h"
 #include "source/common/network/address_impl.h"
+#include "source/common/router/string_accessor_impl.h"
 #include "test/common/stream_info/test_util.h"
 #include "test/mocks/stream_info/mocks.h"
 #include "test/mocks/server/factory_context.h"
+#include "test/mocks/ssl/mocks.h"
 #include "test/test_common/utility.h"
 
 #include "gmock/gmock.h"
@@ -50,6 +53,10 @@ public:
   ~MockWorkloadMetadataProvider() override {}
   MOCK_METHOD(std::optional<WorkloadMetadataObject>, GetMetadata,
               (const Network::Address::InstanceConstSharedPtr& address));
+  MOCK_METHOD(std::optional<WorkloadMetadataObject>, GetMetadataByIdentity,
+              (absl::string_view identity));
+  MOCK_METHOD(std::optional<WorkloadMetadataObject>, GetMetadataByUid, (absl::string_view uid));
+  MOCK_METHOD(bool, HasUid, (absl::string_view uid));
 };
 
 class PeerMetadataTest : public testing::Test {
@@ -84,6 +91,13 @@ protected:
     ASSERT_NE(nullptr, obj);
     EXPECT_EQ(expected, obj->namespace_name_);
   }
+  void setLocalWorkload() {
+    auto& fields =
+        *context_.server_factory_context_.local_info_.node_.mutable_metadata()->mutable_fields();
+    fields["CLUSTER_ID"].set_string_value("my-cluster");
+    fields["NAMESPACE"].set_string_value("default");
+    fields["NAME"].set_string_value("pod-bar-5678");
+  }
   void checkShared(bool expected) {
     EXPECT_EQ(expected,
               stream_info_.filterState()->objectsSharedWithUpstreamConnection()->size() > 0);
@@ -141,6 +155,28 @@ TEST_F(PeerMetadataTest, DownstreamXDS) {
   checkShared(false);
 }
 
+TEST_F(PeerMetadataTest, DownstreamXDSConnectionPeer) {
+  const WorkloadMetadataObject pod("pod-foo-1234", "my-cluster", "bar", "foo", "foo-service",
+                                   "v1alpha3", "", "", Istio::Common::WorkloadType::Pod, "");
+  stream_info_.filterState()->setData(
+      Istio::Common::ConnectionPeer, std::make_shared<WorkloadMetadataObject>(pod),
+      StreamInfo::FilterState::StateType::Mutable, StreamInfo::FilterState::LifeSpan::Connection);
+  EXPECT_CALL(*metadata_provider_, GetMetadata(_)).Times(0);
+  initialize(R"EOF(
+    downstream_discovery:
+      - workload_discovery: {}
+  )EOF");
+  EXPECT_EQ(0, request_headers_.size());
+  EXPECT_EQ(0, response_headers_.size());
+  checkPeerNamespace(true, "bar");
+  checkNoPeer(false);
+  // The stream shares the connection object.
+  EXPECT_EQ(stream_info_.filterState()->getDataReadOnly<WorkloadMetadataObject>(
+                Istio::Common::ConnectionPeer),
+            stream_info_.filterState()->getDataReadOnly<WorkloadMetadataObject>(
+                Istio::Common::DownstreamPeer));
+}
+
 TEST_F(PeerMetadataTest, UpstreamXDS) {
   const WorkloadMetadataObject pod("pod-foo-1234", "my-cluster", "foo", "foo", "foo-service",
                                    "v1alpha3", "", "", Istio::Common::WorkloadType::Pod, "");
@@ -198,6 +234,90 @@ TEST_F(PeerMetadataTest, UpstreamXDSInternal) {
   checkPeerNamespace(false, "foo");
 }
 
+TEST_F(PeerMetadataTest, DownstreamXDSIdentity) {
+  const std::vector<std::string> peer_sans{"spiffe://cluster.local/ns/default/sa/foo"};
+  auto ssl = std::make_shared<NiceMock<Ssl::MockConnectionInfo>>();
+  ON_CALL(*ssl, uriSanPeerCertificate()).WillByDefault(Return(peer_sans));
+  stream_info_.downstream_connection_info_provider_->setSslConnection(ssl);
+  const WorkloadMetadataObject pod("", "my-cluster", "default", "foo", "foo-service", "v1alpha3",
+                                   "", "", Istio::Common::WorkloadType::Pod,
+                                   "spiffe://cluster.local/ns/default/sa/foo");
+  EXPECT_CALL(*metadata_provider_, GetMetadata(_)).Times(0);
+  EXPECT_CALL(*metadata_provider_,
+              GetMetadataByIdentity("spiffe://cluster.local/ns/default/sa/foo"))
+      .WillOnce(Return(pod));
+  initialize(R"EOF(
+    downstream_discovery:
+      - workload_identity_discovery: {}
+  )EOF");
+  EXPECT_EQ(0, request_headers_.size());
+  EXPECT_EQ(0, response_headers_.size());
+  checkPeerNamespace(true, "default");
+  checkNoPeer(false);
+}
+
+TEST_F(PeerMetadataTest, DownstreamXDSIdentityPeerPrincipal) {
+  stream_info_.filterState()->setData(
+      "io.istio.peer_principal",
+      std::make_shared<Router::StringAccessorImpl>("spiffe://cluster.local/ns/bar/sa/foo"),
+      StreamInfo::FilterState::StateType::ReadOnly, StreamInfo::FilterState::LifeSpan::FilterChain);
+  const WorkloadMetadataObject pod("", "my-cluster", "bar", "foo", "foo-service", "v1alpha3", "",
+                                   "", Istio::Common::WorkloadType::Pod,
+                                   "spiffe://cluster.local/ns/bar/sa/foo");
+  EXPECT_CALL(*metadata_provider_, GetMetadataByIdentity("spiffe://cluster.local/ns/bar/sa/foo"))
+      .WillOnce(Return(pod));
+  initialize(R"EOF(
+    downstream_discovery:
+      - workload_identity_discovery: {}
+  )EOF");
+  checkPeerNamespace(true, "bar");
+  checkNoPeer(false);
+}
+
+TEST_F(PeerMetadataTest, DownstreamXDSIdentityNoTLS) {
+  EXPECT_CALL(*metadata_provider_, GetMetadataByIdentity(_)).Times(0);
+  initialize(R"EOF(
+    downstream_discovery:
+      - workload_identity_discovery: {}
+  )EOF");
+  checkNoPeer(true);
+  checkNoPeer(false);
+}
+
+TEST_F(PeerMetadataTest, DownstreamXDSIdentityFallback) {
+  const WorkloadMetadataObject pod("pod-foo-1234", "my-cluster", "default", "foo", "foo-service",
+                                   "v1alpha3", "", "", Istio::Common::WorkloadType::Pod, "");
+  EXPECT_CALL(*metadata_provider_, GetMetadataByIdentity(_)).Times(0);
+  EXPECT_CALL(*metadata_provider_, GetMetadata(_)).WillOnce(Return(pod));
+  initialize(R"EOF(
+    downstream_discovery:
+      - workload_identity_discovery: {}
+      - workload_discovery: {}
+  )EOF");
+  checkPeerNamespace(true, "default");
+  checkNoPeer(false);
+}
+
+TEST_F(PeerMetadataTest, UpstreamXDSIdentity) {
+  const std::vector<std::string> peer_sans{"spiffe://cluster.local/ns/foo/sa/foo"};
+  auto ssl = std::make_shared<NiceMock<Ssl::MockConnectionInfo>>();
+  ON_CALL(*ssl, uriSanPeerCertificate()).WillByDefault(Return(peer_sans));
+  stream_info_.upstreamInfo()->setUpstreamSslConnection(ssl);
+  const WorkloadMetadataObject pod("", "my-cluster", "foo", "foo", "foo-service", "v1alpha3", "",
+                                   "", Istio::Common::WorkloadType::Pod,
+                                   "spiffe://cluster.local/ns/foo/sa/foo");
+  EXPECT_CALL(*metadata_provider_, GetMetadataByIdentity("spiffe://cluster.local/ns/foo/sa/foo"))
+      .WillOnce(Return(pod));
+  initialize(R"EOF(
+    upstream_discovery:
+      - workload_identity_discovery: {}
+  )EOF");
+  EXPECT_EQ(0, request_headers_.size());
+  EXPECT_EQ(0, response_headers_.size());
+  checkNoPeer(true);
+  checkPeerNamespace(false, "foo");
+}
+
 TEST_F(PeerMetadataTest, DownstreamMXEmpty) {
   initialize(R"EOF(
     downstream_discovery:
@@ -281,7 +401,7 @@ TEST(MXMethod, Cache) {
       request_headers.setReference(Headers::get().ExchangeMetadataHeader, SampleIstioHeader);
       Context ctx;
       const auto result = method.derivePeerInfo(stream_info, request_headers, ctx);
-      EXPECT_TRUE(result.has_value());
+      EXPECT_NE(nullptr, result);
     }
   }
 }
@@ -433,7 +553,9 @@ TEST_F(PeerMetadataTest, UpstreamMXPropagationSkip) {
           external: true
     )EOF");
   ON_CALL(stream_info_, upstreamClusterInfo()).WillByDefault(testing::Return(cluster_info_));
-  ON_CALL(*cluster_info_, metadata()).WillByDefault(ReturnRef(metadata));
+  const Envoy::Config::TypedMetadataImpl<Upstream::ClusterTypedMetadataFactory> typed_metadata(
+      metadata);
+  ON_CALL(*cluster_info_, typedMetadata()).WillByDefault(ReturnRef(typed_metadata));
   initialize(R"EOF(
     upstream_propagation:
       - istio_headers:
@@ -461,6 +583,118 @@ TEST_F(PeerMetadataTest, UpstreamMXPropagationSkipPassthrough) {
   checkNoPeer(false);
 }
 
+TEST_F(PeerMetadataTest, DownstreamUid) {
+  const WorkloadMetadataObject pod("pod-foo-1234", "my-cluster", "foo", "foo", "foo-service",
+                                   "v1alpha3", "", "", Istio::Common::WorkloadType::Pod, "");
+  request_headers_.setReference(Headers::get().ExchangeMetadataHeaderUid,
+                                "my-cluster//Pod/foo/pod-foo-1234");
+  EXPECT_CALL(*metadata_provider_, GetMetadataByUid("my-cluster//Pod/foo/pod-foo-1234"))
+      .WillOnce(Return(pod));
+  initialize(R"EOF(
+    downstream_discovery:
+      - workload_uid: {}
+      - istio_headers: {}
+  )EOF");
+  EXPECT_EQ(0, request_headers_.size());
+  EXPECT_EQ(0, response_headers_.size());
+  checkPeerNamespace(true, "foo");
+  checkNoPeer(false);
+}
+
+TEST_F(PeerMetadataTest, DownstreamUidFallback) {
+  request_headers_.setReference(Headers::get().ExchangeMetadataHeaderId, "test-pod");
+  request_headers_.setReference(Headers::get().ExchangeMetadataHeader, SampleIstioHeader);
+  EXPECT_CALL(*metadata_provider_, GetMetadataByUid(_)).Times(0);
+  initialize(R"EOF(
+    downstream_discovery:
+      - workload_uid: {}
+      - istio_headers: {}
+  )EOF");
+  EXPECT_EQ(0, request_headers_.size());
+  EXPECT_EQ(0, response_headers_.size());
+  checkPeerNamespace(true, "default");
+  checkNoPeer(false);
+}
+
+TEST_F(PeerMetadataTest, UpstreamUidPropagation) {
+  setLocalWorkload();
+  EXPECT_CALL(*metadata_provider_, HasUid("my-cluster//Pod/default/pod-bar-5678"))
+      .WillOnce(Return(true));
+  EXPECT_CALL(*metadata_provider_, GetMetadataByUid(_)).Times(0);
+  initialize(R"EOF(
+    upstream_propagation:
+      - workload_uid: {}
+  )EOF");
+  EXPECT_EQ(1, request_headers_.size());
+  EXPECT_EQ("my-cluster//Pod/default/pod-bar-5678",
+            request_headers_.get_(Headers::get().ExchangeMetadataHeaderUid));
+  EXPECT_EQ(0, response_headers_.size());
+}
+
+TEST_F(PeerMetadataTest, UpstreamUidPropagationUnknown) {
+  setLocalWorkload();
+  EXPECT_CALL(*metadata_provider_, HasUid(_)).WillOnce(Return(false));
+  initialize(R"EOF(
+    upstream_propagation:
+      - workload_uid: {}
+  )EOF");
+  EXPECT_EQ(2, request_headers_.size());
+  EXPECT_FALSE(request_headers_.has(Headers::get().ExchangeMetadataHeaderUid));
+  EXPECT_EQ(0, response_headers_.size());
+}
+
+TEST_F(PeerMetadataTest, UpstreamUidPropagationSkipPassthrough) {
+  std::shared_ptr<Upstream::MockClusterInfo> cluster_info_{
+      std::make_shared<NiceMock<Upstream::MockClusterInfo>>()};
+  cluster_info_->name_ = "PassthroughCluster";
+  ON_CALL(stream_info_, upstreamClusterInfo()).WillByDefault(testing::Return(cluster_info_));
+  initialize(R"EOF(
+    upstream_propagation:
+      - workload_uid:
+          skip_external_clusters: true
+  )EOF");
+  EXPECT_EQ(0, request_headers_.size());
+  EXPECT_EQ(0, response_headers_.size());
+}
+
+TEST_F(PeerMetadataTest, DownstreamUidDiscoveryPropagation) {
+  setLocalWorkload();
+  const WorkloadMetadataObject pod("pod-foo-1234", "my-cluster", "foo", "foo", "foo-service",
+                                   "v1alpha3", "", "", Istio::Common::WorkloadType::Pod, "");
+  request_headers_.setReference(Headers::get().ExchangeMetadataHeaderUid,
+                                "my-cluster//Pod/foo/pod-foo-1234");
+  EXPECT_CALL(*metadata_provider_, GetMetadataByUid(_)).WillRepeatedly(Return(pod));
+  EXPECT_CALL(*metadata_provider_, HasUid(_)).WillRepeatedly(Return(true));
+  initialize(R"EOF(
+    downstream_discovery:
+      - workload_uid: {}
+    downstream_propagation:
+      - workload_uid: {}
+  )EOF");
+  EXPECT_EQ(0, request_headers_.size());
+  EXPECT_EQ(1, response_headers_.size());
+  EXPECT_EQ("my-cluster//Pod/default/pod-bar-5678",
+            response_headers_.get_(Headers::get().ExchangeMetadataHeaderUid));
+  checkPeerNamespace(true, "foo");
+}
+
+TEST_F(PeerMetadataTest, DownstreamMXDiscoveryUidPropagation) {
+  request_headers_.setReference(Headers::get().ExchangeMetadataHeaderId, "test-pod");
+  request_headers_.setReference(Headers::get().ExchangeMetadataHeader, SampleIstioHeader);
+  EXPECT_CALL(*metadata_provider_, GetMetadataByUid(_)).Times(0);
+  initialize(R"EOF(
+    downstream_discovery:
+      - workload_uid: {}
+      - istio_headers: {}
+    downstream_propagation:
+      - workload_uid: {}
+  )EOF");
+  EXPECT_EQ(0, request_headers_.size());
+  EXPECT_EQ(2, response_headers_.size());
+  EXPECT_FALSE(response_headers_.has(Headers::get().ExchangeMetadataHeaderUid));
+  checkPeerNamespace(true, "default");
+}
+
 } // namespace
 } // namespace PeerMetadata
 } // namespace HttpFilters
@@ -0,0 +1,60 @@
+// Copyright Istio Authors. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "source/extensions/filters/listener/peer_metadata/filter.h"
+
+#include "envoy/registry/registry.h"
+#include "envoy/stream_info/filter_state.h"
+
+#include "extensions/common/metadata_object.h"
+
+namespace Envoy {
+namespace Extensions {
+namespace ListenerFilters {
+namespace PeerMetadata {
+
+Network::FilterStatus Filter::onAccept(Network::ListenerFilterCallbacks& cb) {
+  const auto& metadata_provider = config_->metadataProvider();
+  if (!metadata_provider) {
+    return Network::FilterStatus::Continue;
+  }
+  const auto& peer_address = cb.socket().connectionInfoProvider().remoteAddress();
+  const auto peer = metadata_provider->GetMetadata(peer_address);
+  if (peer) {
+    ENVOY_LOG(trace, "Resolved peer metadata for {}", peer_address->asString());
+    // Mutable, so that the HTTP filter can share the object with the streams of the connection.
+    cb.filterState().setData(Istio::Common::ConnectionPeer,
+                             std::make_shared<Istio::Common::WorkloadMetadataObject>(*peer),
+                             StreamInfo::FilterState::StateType::Mutable,
+                             StreamInfo::FilterState::LifeSpan::Connection);
+  }
+  return Network::FilterStatus::Continue;
+}
+
+Network::ListenerFilterFactoryCb FilterConfigFactory::createListenerFilterFactoryFromProto(
+    const Protobuf::Message&, const Network::ListenerFilterMatcherSharedPtr& matcher,
+    Server::Configuration::ListenerFactoryContext& context) {
+  auto filter_config = std::make_shared<FilterConfig>(
+      Extensions::Common::WorkloadDiscovery::GetProvider(context.serverFactoryContext()));
+  return [filter_config, matcher](Network::ListenerFilterManager& filter_manager) {
+    filter_manager.addAcceptFilter(matcher, std::make_unique<Filter>(filter_config));
+  };
+}
+
+REGISTER_FACTORY(FilterConfigFactory, Server::Configuration::NamedListenerFilterConfigFactory);
+
+} // namespace PeerMetadata
+} // namespace ListenerFilters
+} // namespace Extensions
+} // namespace Envoy
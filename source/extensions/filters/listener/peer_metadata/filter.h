@@ -0,0 +1,75 @@
+// Copyright Istio Authors. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#pragma once
+
+#include "envoy/network/filter.h"
+#include "envoy/server/filter_config.h"
+#include "source/extensions/filters/listener/peer_metadata/config.pb.h"
+#include "source/extensions/common/workload_discovery/api.h"
+
+namespace Envoy {
+namespace Extensions {
+namespace ListenerFilters {
+namespace PeerMetadata {
+
+class FilterConfig {
+public:
+  FilterConfig(Extensions::Common::WorkloadDiscovery::WorkloadMetadataProviderSharedPtr provider)
+      : metadata_provider_(provider) {}
+  const Extensions::Common::WorkloadDiscovery::WorkloadMetadataProviderSharedPtr&
+  metadataProvider() const {
+    return metadata_provider_;
+  }
+
+private:
+  Extensions::Common::WorkloadDiscovery::WorkloadMetadataProviderSharedPtr metadata_provider_;
+};
+
+using FilterConfigSharedPtr = std::shared_ptr<FilterConfig>;
+
+// Resolves the downstream peer from the remote address once per connection and stores it under
+// the ConnectionPeer filter state key for the network and HTTP filters to share.
+class Filter : public Network::ListenerFilter, Logger::Loggable<Logger::Id::filter> {
+public:
+  Filter(const FilterConfigSharedPtr& config) : config_(config) {}
+
+  // Network::ListenerFilter
+  Network::FilterStatus onAccept(Network::ListenerFilterCallbacks& cb) override;
+  Network::FilterStatus onData(Network::ListenerFilterBuffer&) override {
+    return Network::FilterStatus::Continue;
+  }
+  size_t maxReadBytes() const override { return 0; }
+
+private:
+  FilterConfigSharedPtr config_;
+};
+
+class FilterConfigFactory : public Server::Configuration::NamedListenerFilterConfigFactory {
+public:
+  std::string name() const override { return "envoy.filters.listener.peer_metadata"; }
+
+  ProtobufTypes::MessagePtr createEmptyConfigProto() override {
+    return std::make_unique<io::istio::listener::peer_metadata::Config>();
+  }
+
+  Network::ListenerFilterFactoryCb createListenerFilterFactoryFromProto(
+      const Protobuf::Message&, const Network::ListenerFilterMatcherSharedPtr& matcher,
+      Server::Configuration::ListenerFactoryContext& context) override;
+};
+
+} // namespace PeerMetadata
+} // namespace ListenerFilters
+} // namespace Extensions
+} // namespace Envoy
@@ -0,0 +1,99 @@
+// Copyright Istio Authors. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "source/extensions/filters/listener/peer_metadata/filter.h"
+
+#include "source/common/network/address_impl.h"
+#include "source/common/stream_info/filter_state_impl.h"
+#include "test/mocks/network/mocks.h"
+
+#include "extensions/common/metadata_object.h"
+
+#include "gmock/gmock.h"
+#include "gtest/gtest.h"
+
+using Istio::Common::WorkloadMetadataObject;
+using testing::_;
+using testing::Return;
+using testing::ReturnRef;
+
+namespace Envoy {
+namespace Extensions {
+namespace ListenerFilters {
+namespace PeerMetadata {
+namespace {
+
+class MockWorkloadMetadataProvider
+    : public Extensions::Common::WorkloadDiscovery::WorkloadMetadataProvider {
+public:
+  MOCK_METHOD(std::optional<WorkloadMetadataObject>, GetMetadata,
+              (const Network::Address::InstanceConstSharedPtr& address));
+  MOCK_METHOD(std::optional<WorkloadMetadataObject>, GetMetadataByIdentity,
+              (absl::string_view identity));
+  MOCK_METHOD(std::optional<WorkloadMetadataObject>, GetMetadataByUid, (absl::string_view uid));
+  MOCK_METHOD(bool, HasUid, (absl::string_view uid));
+};
+
+class PeerMetadataListenerTest : public testing::Test {
+protected:
+  PeerMetadataListenerTest() {
+    ON_CALL(callbacks_, filterState()).WillByDefault(ReturnRef(filter_state_));
+    callbacks_.socket_.connection_info_provider_->setRemoteAddress(
+        std::make_shared<Network::Address::Ipv4Instance>("127.0.0.1", 8080));
+  }
+  Network::FilterStatus accept(
+      Extensions::Common::WorkloadDiscovery::WorkloadMetadataProviderSharedPtr provider) {
+    Filter filter(std::make_shared<FilterConfig>(provider));
+    return filter.onAccept(callbacks_);
+  }
+
+  NiceMock<Network::MockListenerFilterCallbacks> callbacks_;
+  StreamInfo::FilterStateImpl filter_state_{StreamInfo::FilterState::LifeSpan::Connection};
+};
+
+TEST_F(PeerMetadataListenerTest, NoProvider) {
+  EXPECT_EQ(Network::FilterStatus::Continue, accept(nullptr));
+  EXPECT_FALSE(filter_state_.hasDataWithName(Istio::Common::ConnectionPeer));
+}
+
+TEST_F(PeerMetadataListenerTest, NotFound) {
+  auto provider = std::make_shared<MockWorkloadMetadataProvider>();
+  EXPECT_CALL(*provider, GetMetadata(_)).WillOnce(Return(std::nullopt));
+  EXPECT_EQ(Network::FilterStatus::Continue, accept(provider));
+  EXPECT_FALSE(filter_state_.hasDataWithName(Istio::Common::ConnectionPeer));
+}
+
+TEST_F(PeerMetadataListenerTest, Found) {
+  const WorkloadMetadataObject pod("pod-foo-1234", "my-cluster", "default", "foo", "foo-service",
+                                   "v1alpha3", "", "", Istio::Common::WorkloadType::Pod, "");
+  auto provider = std::make_shared<MockWorkloadMetadataProvider>();
+  EXPECT_CALL(*provider, GetMetadata(_))
+      .WillOnce([&](const Network::Address::InstanceConstSharedPtr& address)
+                    -> std::optional<WorkloadMetadataObject> {
+        EXPECT_EQ("127.0.0.1:8080", address->asString());
+        return pod;
+      });
+  EXPECT_EQ(Network::FilterStatus::Continue, accept(provider));
+  const auto* peer =
+      filter_state_.getDataReadOnly<WorkloadMetadataObject>(Istio::Common::ConnectionPeer);
+  ASSERT_NE(nullptr, peer);
+  EXPECT_EQ("pod-foo-1234", peer->instance_name_);
+  EXPECT_EQ("foo", peer->workload_name_);
+}
+
+} // namespace
+} // namespace PeerMetadata
+} // namespace ListenerFilters
+} // namespace Extensions
+} // namespace Envoy
@@ -271,6 +271,17 @@ void MetadataExchangeFilter::updatePeer(const Istio::Common::WorkloadMetadataObj
 std::string MetadataExchangeFilter::getMetadataId() { return local_info_.node().id(); }
 
 void MetadataExchangeFilter::setMetadataNotFoundFilterState() {
+  // Reuse the peer resolved by the listener filter when the connection was accepted.
+  const auto* connection_peer =
+      read_callbacks_->connection()
+          .streamInfo()
+          .filterState()
+          ->getDataReadOnly<Istio::Common::WorkloadMetadataObject>(Istio::Common::ConnectionPeer);
+  if (connection_peer) {
+    updatePeer(*connection_peer);
+    config_->stats().metadata_added_.inc();
+    return;
+  }
   if (config_->metadata_provider_) {
     const Network::Address::InstanceConstSharedPtr peer_address =
         read_callbacks_->connection().connectionInfoProvider().remoteAddress();
@@ -127,6 +127,29 @@ TEST_F(MetadataExchangeFilterTest, MetadataExchangeNotFound) {
   EXPECT_EQ(1UL, config_->stats().alpn_protocol_not_found_.value());
 }
 
+TEST_F(MetadataExchangeFilterTest, MetadataExchangeConnectionPeer) {
+  initialize();
+  const Istio::Common::WorkloadMetadataObject pod("pod-foo-1234", "my-cluster", "default", "foo",
+                                                  "foo-service", "v1alpha3", "", "",
+                                                  Istio::Common::WorkloadType::Pod, "");
+  stream_info_.filterState()->setData(
+      Istio::Common::ConnectionPeer, std::make_shared<Istio::Common::WorkloadMetadataObject>(pod),
+      StreamInfo::FilterState::StateType::ReadOnly, StreamInfo::FilterState::LifeSpan::Connection);
+
+  EXPECT_CALL(read_filter_callbacks_.connection_, nextProtocol()).WillRepeatedly(Return("istio"));
+
+  ::Envoy::Buffer::OwnedImpl data{};
+  EXPECT_EQ(Envoy::Network::FilterStatus::Continue, filter_->onData(data, false));
+  EXPECT_EQ(1UL, config_->stats().alpn_protocol_not_found_.value());
+  EXPECT_EQ(1UL, config_->stats().metadata_added_.value());
+  const auto* peer =
+      stream_info_.filterState()->getDataReadOnly<Istio::Common::WorkloadMetadataObject>(
+          Istio::Common::DownstreamPeer);
+  ASSERT_NE(nullptr, peer);
+  EXPECT_EQ("foo", peer->workload_name_);
+  EXPECT_FALSE(stream_info_.filterState()->hasDataWithName(Istio::Common::NoPeer));
+}
+
 } // namespace MetadataExchange
 } // namespace Tcp
 } // namespace Envoy
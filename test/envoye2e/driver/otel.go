@@ -71,9 +71,10 @@ func (x *OtelMetrics) Export(ctx context.Context, req *colmetricspb.ExportMetric
 				log.Printf("scope=%s\n", protojson.Format(sm.Scope))
 			}
 			for _, m := range sm.Metrics {
-				// Clean up time field in the received metric.
+				// Clean up time fields in the received metric.
 				if sum := m.GetSum(); sum != nil {
 					for _, dp := range sum.DataPoints {
+						dp.StartTimeUnixNano = 0
 						dp.TimeUnixNano = 0
 					}
 				}
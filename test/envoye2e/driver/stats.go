@@ -149,6 +149,48 @@ func (me *PartialStat) Matches(params *Params, that *dto.MetricFamily) error {
 
 var _ StatMatcher = &PartialStat{}
 
+// LabelStat matches if the metric has a series with the labels of each series in the test data,
+// but does not compare the other labels and the values.
+type LabelStat struct {
+	Metric string
+}
+
+func (me *LabelStat) Matches(params *Params, that *dto.MetricFamily) error {
+	metric := &dto.MetricFamily{}
+	params.LoadTestProto(me.Metric, metric)
+	for _, wm := range metric.Metric {
+		found := false
+		for _, gm := range that.Metric {
+			if hasLabels(gm, wm.Label) {
+				found = true
+				break
+			}
+		}
+		if !found {
+			return fmt.Errorf("cannot find labels, got: %v, want: %v", that.Metric, wm.Label)
+		}
+	}
+	return nil
+}
+
+func hasLabels(metric *dto.Metric, labels []*dto.LabelPair) bool {
+	for _, want := range labels {
+		found := false
+		for _, got := range metric.Label {
+			if got.GetName() == want.GetName() && got.GetValue() == want.GetValue() {
+				found = true
+				break
+			}
+		}
+		if !found {
+			return false
+		}
+	}
+	return true
+}
+
+var _ StatMatcher = &LabelStat{}
+
 type MissingStat struct {
 	Metric string
 }
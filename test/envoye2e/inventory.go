@@ -23,6 +23,7 @@ var ProxyE2ETests = &env.TestInventory{}
 func init() {
 	ProxyE2ETests.Tests = append(ProxyE2ETests.Tests, []string{
 		"TestAttributeGen",
+		"TestStatsRequestClassification",
 		"TestBasicFlow",
 		"TestBasicHTTP",
 		"TestBasicHTTPGateway",
@@ -55,5 +56,11 @@ func init() {
 		"TestTCPMetadataExchangeWithConnectionTermination",
 		"TestTCPMetadataNotFoundReporting",
 		"TestStatsDestinationServiceNamespacePrecedence",
+		"TestStatsCardinalityLimit",
+		"TestStatsCardinalityLimitIdleSeriesEviction",
+		"TestStatsIdleSeriesEviction",
+		"TestStatsOtlpDeltaExport",
+		"TestStatsAsyncRecording",
+		"TestStatsLatencyPhaseOverride",
 	}...)
 }